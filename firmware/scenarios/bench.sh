@@ -0,0 +1,19 @@
+#!/bin/sh
+# Build the simulator and run all scenarios, fails on any failed
+# expectation or exceeded budget.
+set -u
+cd "$(dirname "$0")/.."
+
+sim="${TMPDIR:-/tmp}/teatime-sim"
+${CC:-cc} -std=gnu11 -O2 -Wall -Wextra \
+  -D SIMULATOR -D F_CPU=10000000L src/*.c src/sim/*.c -o "$sim" || exit 2
+
+status=0
+for scenario in scenarios/*.txt; do
+  if output="$("$sim" < "$scenario")"; then result=ok; else result=FAILED; status=1; fi
+  # the last total, scenarios with a reset print one per part
+  charge="$(printf '%s\n' "$output" | awk '$1 == "total" { c = $2 " " $3 } END { print c }')"
+  printf '%-24s %-8s %s\n' "$(basename "$scenario" .txt)" "$result" "$charge"
+  [ "$result" = ok ] || printf '%s\n' "$output" | grep -E 'FAIL|OVER BUDGET'
+done
+exit $status
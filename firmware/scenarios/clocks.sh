@@ -0,0 +1,18 @@
+#!/bin/sh
+# Compare the clock points: build the simulator once per CLOCK_AWAKE and
+# print the charge of each scenario and the awake charge per lcd update.
+set -u
+cd "$(dirname "$0")/.."
+
+sim="${TMPDIR:-/tmp}/teatime-sim-clock"
+for point in clock_10mhz clock_5mhz clock_2500khz; do
+  ${CC:-cc} -std=gnu11 -O2 -Wall -Wextra -Wno-unused-parameter \
+    -D SIMULATOR -D F_CPU=10000000L -D CLOCK_AWAKE=$point \
+    src/*.c src/sim/*.c -o "$sim" || exit 2
+  for scenario in scenarios/brew.txt scenarios/steeps.txt scenarios/long.txt; do
+    "$sim" < "$scenario" | awk -v point=$point -v name="$(basename "$scenario" .txt)" '
+      $1 == "total" { total = $2 " " $3 }
+      $1 == "per" { update = $4 " " $5 }
+      END { printf "%-14s %-8s %s  %s per update\n", point, name, total, update }'
+  done
+done
@@ -0,0 +1,95 @@
+// Sparse battery voltage measurements with the ADC
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#include "battery.h"
+#include "events.h"
+#include "profile.h"
+#include "trace.h"
+
+/**
+ * VDD is measured indirectly: the ADC converts the internal 1.1 V
+ * reference against VDD as its reference, so a lower supply yields a
+ * higher result. Four accumulated samples smooth the conversion noise
+ * and a running average over the measurements smooths the load.
+ *
+ * A measurement is only started when the cpu is awake anyway, i.e.
+ * once per brew and once per wakeup from power-down. The ADC runs in
+ * standby until its result is ready and is switched off right after,
+ * so it costs about 150 µs of the 20 MHz oscillator each time.
+ **/
+
+// the 1.1 V reference is 1100 / VDD[mV] of the full scale of 1023 and
+// four samples are accumulated: result = 1100 * 1023 * 4 / VDD[mV],
+// so VDD[mV] = BATTERY_SCALE / result, e.g. a result of 1500 at 3.0 V
+#define BATTERY_SCALE (1100UL * 1023 * 4)
+
+// filtered voltage, zero before the first measurement
+static uint16_t filtered = 0;
+
+// last conversion result, until the main loop picks it up
+static volatile uint16_t result = 0;
+
+// start a conversion, the result is ready in the interrupt below
+void battery_sample() {
+  if (ADC0.CTRLA & ADC_ENABLE_bm) return;
+  VREF.CTRLA = (VREF.CTRLA & ~VREF_ADC0REFSEL_gm) | VREF_ADC0REFSEL_1V1_gc;
+  ADC0.CTRLB = ADC_SAMPNUM_ACC4_gc;
+  ADC0.CTRLC = ADC_SAMPCAP_bm | ADC_REFSEL_VDDREF_gc | ADC_PRESC_DIV16_gc;
+  // wait for the reference to start up before the first sample
+  ADC0.CTRLD = ADC_INITDLY_DLY32_gc;
+  ADC0.MUXPOS = ADC_MUXPOS_INTREF_gc;
+  ADC0.INTCTRL = ADC_RESRDY_bm;
+  ADC0.CTRLA = ADC_RUNSTBY_bm | ADC_RESSEL_10BIT_gc | ADC_ENABLE_bm;
+  ADC0.COMMAND = ADC_STCONV_bm;
+}
+
+ISR(ADC0_RESRDY_vect) {
+  profile_isr(profile_adc);
+  trace(trace_isr, profile_adc);
+  result = ADC0.RES;
+  ADC0.CTRLA = 0;
+  ADC0.INTFLAGS = ADC_RESRDY_bm;
+  events_post(event_battery);
+}
+
+// convert and filter the result in the main loop
+void battery_event() {
+  uint16_t raw;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    raw = result;
+  }
+  if (raw == 0) return;
+  uint16_t mv = BATTERY_SCALE / raw;
+  // average with a weight of 1/4 for each new measurement
+  filtered = filtered ? filtered - (filtered >> 2) + (mv >> 2) : mv;
+  battery_measured();
+}
+
+uint16_t battery_mv() {
+  return filtered;
+}
+
+// rough discharge curve of a CR2032 at a light load
+static const struct { uint16_t mv; uint8_t percent; } curve[] = {
+  { 3000, 100 }, { 2900, 80 }, { 2800, 50 }, { 2700, 25 }, { 2500, 10 }, { 2200, 0 },
+};
+
+// state of charge estimate, interpolated on the curve above
+uint8_t battery_percent() {
+  uint16_t mv = filtered;
+  if (mv >= curve[0].mv) return 100;
+  for (uint8_t i = 1; i < sizeof(curve) / sizeof(curve[0]); i++) {
+    if (mv < curve[i].mv) continue;
+    uint16_t span = curve[i - 1].mv - curve[i].mv;
+    uint8_t range = curve[i - 1].percent - curve[i].percent;
+    return curve[i].percent + (uint32_t)(mv - curve[i].mv) * range / span;
+  }
+  return 0;
+}
+
+battery_level battery_state() {
+  if (filtered == 0 || filtered >= BATTERY_LOW_MV) return battery_ok;
+  if (filtered >= BATTERY_CRITICAL_MV) return battery_low;
+  return battery_critical;
+}
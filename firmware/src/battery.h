@@ -0,0 +1,34 @@
+// Sparse battery voltage measurements with the ADC
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hal.h"
+
+// thresholds on VDD in millivolts, override with -D; the mcu is only
+// specified for 10 MHz down to 2.7 V
+#ifndef BATTERY_LOW_MV
+#define BATTERY_LOW_MV 2800 // save power on the lcd and the led
+#endif
+#ifndef BATTERY_CRITICAL_MV
+#define BATTERY_CRITICAL_MV 2700 // also warn with "Lo bAt"
+#endif
+
+typedef enum {
+  battery_ok = 0,
+  battery_low,
+  battery_critical,
+} battery_level;
+
+void battery_sample();
+void battery_event();
+uint16_t battery_mv();
+uint8_t battery_percent();
+battery_level battery_state();
+
+// called from the main loop with each new measurement
+extern void battery_measured();
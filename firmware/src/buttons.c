@@ -0,0 +1,184 @@
+// Debounced buttons with long-press detection on RTC deadlines
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#include "buttons.h"
+#include "timers.h"
+#include "events.h"
+#include "profile.h"
+#include "flags.h"
+#include "trace.h"
+
+/**
+ * The first edge on a button pin disables that pin's interrupt and sets
+ * a deadline BUTTON_DEBOUNCE later. Contact bounce in between does not
+ * wake the cpu at all. At the deadline the pin is sampled once and the
+ * interrupt is enabled again; a changed level is reported as a press or
+ * a release. While a button is held, further deadlines produce the long
+ * press and its repetitions. The interrupt only mutes the pin and notes
+ * the time of the edge, the rest happens in buttons_event().
+ *
+ * The deadlines use the RTC compare match on the crystal through
+ * timers.c, which keeps running in standby. A timer on the peripheral
+ * clock (TCB, CCL filter) would keep the 20 MHz oscillator running in
+ * standby instead.
+ **/
+
+typedef struct {
+  uint8_t pin;        // pin mask on PORTB
+  bool pressed;       // debounced level
+  bool settling;      // pin interrupt is off until settle_at
+  bool holding;       // next hold event at hold_at
+  bool ignored;       // swallow events until the next release
+  uint8_t holds;      // hold events so far, a release after any is long
+  uint16_t edge_at;   // first edge, written by the interrupt
+  uint16_t settle_at;
+  uint16_t hold_at;
+} button;
+
+static button state[buttons] = {
+  [btn_add] = { .pin = PIN6_bm },
+  [btn_set] = { .pin = PIN7_bm },
+};
+
+// the pins that were muted by the interrupt since the last
+// buttons_event() are the bits of EDGE_FLAGS, see flags.h
+
+
+// ---------- pins ---------- //
+
+// setup buttons with pin-change interrupts
+void setup_buttons() {
+  // set PB6, PB7 as inputs
+  PORTB.DIRCLR = PIN6_bm | PIN7_bm;
+  // enable pin interrupts on those pins, no inversion, no pullup
+  PORTB.PIN6CTRL = PORT_ISC_BOTHEDGES_gc; // add
+  PORTB.PIN7CTRL = PORT_ISC_BOTHEDGES_gc; // set
+}
+
+static register8_t *pinctrl(const button *b) {
+  return (b->pin == PIN6_bm) ? &PORTB.PIN6CTRL : &PORTB.PIN7CTRL;
+}
+
+bool buttons_pressed(button_id button) {
+  return state[button].pressed;
+}
+
+// ignore the buttons that are currently down or bouncing until they
+// are released, e.g. the press that woke the device up
+void buttons_ignore() {
+  for (uint8_t i = 0; i < buttons; i++) {
+    if (state[i].pressed || state[i].settling) state[i].ignored = true;
+  }
+}
+
+
+// ---------- deadlines ---------- //
+
+// the pin was stable for long enough, look at its level now
+static void settle(button_id id, button *b) {
+
+  b->settling = false;
+  PORTB.INTFLAGS = b->pin;
+  *pinctrl(b) = PORT_ISC_BOTHEDGES_gc;
+  bool level = PORTB.IN & b->pin;
+  if (level == b->pressed) {
+    // just a glitch, but a swallowed press may have ended
+    if (!level) b->ignored = false;
+    return;
+  }
+
+  // the change happened at the first edge, one debounce period ago
+  uint16_t at = (b->settle_at - BUTTON_DEBOUNCE);
+  b->pressed = level;
+
+  if (level) {
+    b->holds = 0;
+    b->holding = true;
+    b->hold_at = (at + BUTTON_LONG);
+    if (!b->ignored) button_press(id);
+  } else {
+    b->holding = false;
+    if (!b->ignored) button_release(id, b->holds);
+    b->ignored = false;
+  }
+
+}
+
+static void hold(button_id id, button *b) {
+  if (b->holds < UINT8_MAX) b->holds++;
+  b->hold_at = (b->hold_at + BUTTON_REPEAT);
+  b->holding = !b->ignored && button_hold(id, b->holds);
+}
+
+// handle all due deadlines and set the timer for the next one
+static void schedule(timer_id id __attribute__((unused))) {
+
+  uint16_t now = rtc_time();
+  for (uint8_t i = 0; i < buttons; i++) {
+    button *b = &state[i];
+    if (b->settling && timer_due(now, b->settle_at)) settle(i, b);
+    if (b->holding && b->pressed && timer_due(now, b->hold_at)) hold(i, b);
+  }
+
+  // find the nearest remaining deadline
+  uint16_t next = 0;
+  bool pending = false;
+  for (uint8_t i = 0; i < buttons; i++) {
+    button *b = &state[i];
+    if (b->settling && (!pending || timer_until(now, b->settle_at) < timer_until(now, next))) {
+      next = b->settle_at;
+      pending = true;
+    }
+    if (b->holding && (!pending || timer_until(now, b->hold_at) < timer_until(now, next))) {
+      next = b->hold_at;
+      pending = true;
+    }
+  }
+
+  if (pending) {
+    timer_set(timer_buttons, next, schedule);
+  } else {
+    timer_cancel(timer_buttons);
+  }
+
+}
+
+// start debouncing the pins that were muted by the interrupt
+void buttons_event() {
+  uint8_t pins;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    pins = EDGE_FLAGS;
+    EDGE_FLAGS = 0;
+  }
+  for (uint8_t i = 0; i < buttons; i++) {
+    button *b = &state[i];
+    if (!(pins & b->pin)) continue;
+    b->settling = true;
+    b->settle_at = (b->edge_at + BUTTON_DEBOUNCE);
+  }
+  button_edge();
+  schedule(timer_buttons);
+}
+
+ISR(PORTB_PORT_vect) {
+  profile_isr(profile_portb);
+  trace(trace_isr, profile_portb);
+  uint8_t flags = PORTB.INTFLAGS;
+  PORTB.INTFLAGS = flags;
+  // no call to rtc_time(); the twi host handler may trace meanwhile,
+  // which uses the same TEMP register for the 16 bits
+  uint16_t now;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    now = RTC.CNT;
+  }
+  for (uint8_t i = 0; i < buttons; i++) {
+    button *b = &state[i];
+    if (!(flags & b->pin) || (EDGE_FLAGS & b->pin)) continue;
+    // mute the pin until the contacts have settled
+    *pinctrl(b) = PORT_ISC_INTDISABLE_gc;
+    b->edge_at = now;
+    EDGE_FLAGS |= b->pin;
+  }
+  events_post(event_buttons);
+}
@@ -0,0 +1,40 @@
+// Debounced buttons with long-press detection on RTC deadlines
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hal.h"
+#include "oscillators.h"
+
+// buttons on PORTB
+typedef enum {
+  btn_add = 0, // PB6
+  btn_set,     // PB7
+  buttons,
+} button_id;
+
+// timing in 1/1024 seconds, see rtc_time()
+#define BUTTON_DEBOUNCE RTC_MS(20)  // ignore bouncing edges after a change
+#define BUTTON_LONG     RTC_MS(500) // held until the first button_hold()
+#define BUTTON_REPEAT   RTC_MS(500) // between further button_hold() calls
+
+void setup_buttons();
+void buttons_ignore();
+bool buttons_pressed(button_id button);
+void buttons_event();
+
+// called with clean presses and releases; the release gets the number
+// of button_hold() calls during the press, zero for a short one
+extern void button_press(button_id button);
+extern void button_release(button_id button, uint8_t holds);
+
+// called after BUTTON_LONG and then every BUTTON_REPEAT while held,
+// holds counts the calls; return false to stop the repetition
+extern bool button_hold(button_id button, uint8_t holds);
+
+// called on any raw edge before debouncing, e.g. to wake up quickly
+extern void button_edge();
@@ -0,0 +1,55 @@
+// Operating points of the cpu clock, switched at runtime
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#include "clock.h"
+#include "i2c_controller.h"
+#include "led.h"
+
+/**
+ * The awake work is short and mostly waits for the bus, so the clock
+ * is a tradeoff between the cycles of the handlers and the idle current
+ * while a frame goes out. clock_update() applies the point that
+ * clock_policy() asks for, but only between transactions: the TWI baud
+ * rate and the LED pulse length are recomputed for the new clock right
+ * after the switch. The ADC's prescaler stays within its clock range at
+ * all points. The clock registers are not locked for this.
+ **/
+
+static const struct { uint8_t pdiv; uint32_t hz; } points[clock_points] = {
+  [clock_10mhz]   = { CLKCTRL_PDIV_2X_gc, 10000000UL },
+  [clock_5mhz]    = { CLKCTRL_PDIV_4X_gc,  5000000UL },
+  [clock_2500khz] = { CLKCTRL_PDIV_8X_gc,  2500000UL },
+};
+
+static clock_point current = CLOCK_BOOT;
+
+static void clock_set(clock_point point) {
+  current = point;
+  _PROTECTED_WRITE(CLKCTRL.MCLKCTRLB, points[point].pdiv | CLKCTRL_PEN_bm);
+}
+
+// use internal oscillator for the system clock at F_CPU
+void setup_system_clock() {
+  // make sure OSCCFG.FREQSEL fuse is 0x02 for 20 MHz base clock
+
+  // configure system clock source
+  _PROTECTED_WRITE(CLKCTRL.MCLKCTRLA, CLKCTRL_CLKSEL_OSC20M_gc);
+
+  // enable system clock prescaler for F_CPU
+  clock_set(CLOCK_BOOT);
+
+}
+
+uint32_t clock_hz() {
+  return points[current].hz;
+}
+
+// switch to the point of the policy; call with an idle bus
+void clock_update() {
+  clock_point point = clock_policy();
+  if (point == current || point >= clock_points || i2c_busy()) return;
+  clock_set(point);
+  i2c_retime();
+  led_retime();
+}
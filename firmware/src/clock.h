@@ -0,0 +1,37 @@
+// Operating points of the cpu clock, switched at runtime
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#pragma once
+
+#include <stdint.h>
+
+#include "hal.h"
+
+// the 20 MHz oscillator divided down; running at 20 MHz undivided
+// needs 4.5 V and is not offered on a coin cell
+typedef enum {
+  clock_10mhz = 0, // needs 2.7 V
+  clock_5mhz,      // specified down to 1.8 V
+  clock_2500khz,   // the bus falls below F_SCL, see i2c_controller.h
+  clock_points,
+} clock_point;
+
+// F_CPU is the clock at reset, before the policy is first applied
+#if F_CPU == 10000000L
+#define CLOCK_BOOT clock_10mhz
+#elif F_CPU == 5000000L
+#define CLOCK_BOOT clock_5mhz
+#elif F_CPU == 2500000L
+#define CLOCK_BOOT clock_2500khz
+#else
+#error F_CPU should be one of the clock points: 10, 5 or 2.5 MHz
+#endif
+
+void setup_system_clock();
+uint32_t clock_hz();
+void clock_update();
+
+// the policy hook, asked for the point to run at whenever the cpu is
+// about to sleep with an idle bus
+extern clock_point clock_policy();
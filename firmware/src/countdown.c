@@ -0,0 +1,56 @@
+// Countdown time as packed BCD hours, minutes and seconds
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#include "countdown.h"
+
+
+// count down one second, stops at zero
+bcd_time bcd_decrement(bcd_time t) {
+  if (t & 0x0000F) return t - 0x00001;           // 12:34 -> 12:33
+  if (t & 0x000F0) return t - 0x00010 + 0x00009; // 12:30 -> 12:29
+  if (t & 0x00F00) return t - 0x00100 + 0x00059; // 12:00 -> 11:59
+  if (t & 0x0F000) return t - 0x01000 + 0x00959; // 10:00 -> 09:59
+  if (t & 0xF0000) return t - 0x10000 + 0x05959; // 1:00:00 -> 59:59
+  return BCD_ZERO;
+}
+
+// count down several seconds at once, e.g. a whole minute
+bcd_time bcd_subtract(bcd_time t, uint8_t seconds) {
+  while (seconds--) t = bcd_decrement(t);
+  return t;
+}
+
+// add one minute, clamped at 9:59:59
+bcd_time bcd_add_1min(bcd_time t) {
+  t += 0x00100;
+  if ((t & 0x00F00) < 0x00A00) return t;
+  // carry into the tens of minutes
+  t += 0x01000 - 0x00A00;
+  if ((t & 0x0F000) < 0x06000) return t;
+  // carry into the hours
+  t += 0x10000 - 0x06000;
+  if (t > BCD_MAX) return BCD_MAX;
+  return t;
+}
+
+// add ten seconds, clamped at 9:59:59
+bcd_time bcd_add_10s(bcd_time t) {
+  t += 0x00010;
+  if ((t & 0x000F0) < 0x00060) return t;
+  // carry into the minutes
+  if (t >= BCD_MAX) return BCD_MAX;
+  return bcd_add_1min(t - 0x00060);
+}
+
+// round up to full minutes
+bcd_time bcd_ceil_minutes(bcd_time t) {
+  if ((t & 0x000FF) == 0) return t;
+  return bcd_add_1min(t & ~(bcd_time)0x000FF);
+}
+
+// the whole time in binary seconds, at most 35999
+uint16_t bcd_to_seconds(bcd_time t) {
+  uint8_t minutes = bcd_digit(t, 3) * 10 + bcd_digit(t, 2);
+  return (uint16_t)bcd_digit(t, 4) * 3600 + minutes * 60 + bcd_seconds(t);
+}
@@ -0,0 +1,33 @@
+// Countdown time as packed BCD hours, minutes and seconds
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * The time is kept as five BCD digits 0xHMMSS, e.g. 0x11234 is
+ * "1:12:34", so the display only needs to look up each nibble in
+ * NUMBERS. All operations carry digit by digit; the ATtiny has no
+ * hardware divider and a single division costs a few hundred cycles.
+ **/
+typedef uint32_t bcd_time;
+
+#define BCD_ZERO   0x00000
+#define BCD_MINUTE 0x00100
+#define BCD_HOUR   0x10000
+#define BCD_MAX    0x95959 // "9:59:59"
+
+// single digits, least significant first
+#define bcd_digit(t, n) (((t) >> (4 * (n))) & 0x0F)
+
+// the seconds as a binary number
+#define bcd_seconds(t) (bcd_digit(t, 1) * 10 + bcd_digit(t, 0))
+
+bcd_time bcd_decrement(bcd_time t);
+bcd_time bcd_subtract(bcd_time t, uint8_t seconds);
+bcd_time bcd_add_10s(bcd_time t);
+bcd_time bcd_add_1min(bcd_time t);
+bcd_time bcd_ceil_minutes(bcd_time t);
+uint16_t bcd_to_seconds(bcd_time t);
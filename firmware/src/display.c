@@ -0,0 +1,161 @@
+// Shadowed LCD framebuffer with partial DDRAM updates
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#include "display.h"
+#include "lcddriver.h"
+#include "i2c_controller.h"
+#include "events.h"
+#include "flags.h"
+
+
+// copy of the digit bytes that are currently in the DDRAM
+static uint8_t shadow[DISPLAY_DIGITS];
+static bool shadow_valid = false;
+
+// control commands to be chained in front of the next frame
+static uint8_t commands[DISPLAY_COMMANDS];
+static uint8_t commands_len = 0;
+
+// settings last queued for the lcd driver, only changes are sent
+static uint8_t blink = LCD_BLKCTL_off;
+static lcd_power power = lcd_power_alarm;
+
+// the latest frame that could not be queued because the queue was full
+static uint8_t pending[DISPLAY_DIGITS];
+static bool pending_valid = false;
+
+// a failed transaction sets MAIN_LCD_FAILED until display_event()
+
+// count every byte put on the bus and every digit byte we could skip
+uint32_t display_bytes_sent = 0;
+uint32_t display_bytes_skipped = 0;
+
+
+// called from the i2c interrupt, the frame is retried in the main loop
+static void display_complete(i2c_error result) {
+  if (result != success) MAIN_FLAGS |= MAIN_LCD_FAILED;
+  if ((MAIN_FLAGS & MAIN_LCD_FAILED) || pending_valid) events_post(event_display);
+}
+
+// retry a pending frame after a transaction completed
+void display_event() {
+  // the DDRAM contents are unknown after a failed transaction
+  if (MAIN_FLAGS & MAIN_LCD_FAILED) {
+    MAIN_FLAGS &= ~MAIN_LCD_FAILED;
+    shadow_valid = false;
+  }
+  if (pending_valid) {
+    pending_valid = false;
+    display_frame(pending);
+  }
+}
+
+// get notified about completed transactions
+void display_init() {
+  i2c_on_complete(display_complete);
+}
+
+// forget the shadow copy, e.g. after a reset of the lcd driver
+void display_invalidate() {
+  shadow_valid = false;
+}
+
+// queue a control command (mode, blink, ...) to be sent along with the
+// next frame in the same transaction
+void display_command(uint8_t command) {
+  // no more room, send what we have on its own
+  if (commands_len >= DISPLAY_COMMANDS && !display_flush()) return;
+  commands[commands_len++] = command;
+}
+
+// software reset and configuration after the lcd driver was powered on;
+// chained in front of the next frame, the whole sequence goes out in
+// one transaction: reset, power profile, display on and the digits
+void display_reset(lcd_power profile) {
+  // anything queued before is void after the reset
+  commands_len = 0;
+  display_command(LCD_ICSET_cmd | LCD_ICSET_reset);
+  display_command(lcd_disctl(profile));
+  display_command(LCD_MODESET_cmd | LCD_MODESET_ON | LCD_MODESET_bias_03);
+  display_invalidate();
+  blink = LCD_BLKCTL_off;
+  power = profile;
+}
+
+// switch the power profile, e.g. faster frames for the alarm
+void display_power(lcd_power profile) {
+  if (profile == power) return;
+  power = profile;
+  display_command(lcd_disctl(profile));
+}
+
+// set the blink rate, LCD_BLKCTL_off .. LCD_BLKCTL_2Hz
+void display_blink(uint8_t rate) {
+  if (rate == blink) return;
+  blink = rate;
+  display_command(LCD_BLKCTL_cmd | rate);
+}
+
+// send the queued commands on their own without waiting for a frame;
+// returns false if the i2c queue was full
+bool display_flush() {
+  if (commands_len == 0) return true;
+  lcd_batch batch;
+  lcd_begin(&batch);
+  for (uint8_t i = 0; i < commands_len; i++) lcd_command(&batch, commands[i]);
+  if (!lcd_send(&batch)) return false;
+  display_bytes_sent += batch.length;
+  commands_len = 0;
+  return true;
+}
+
+// compare a frame against the shadow copy and only write changed digits;
+// returns false if the i2c queue was full and the frame is sent later
+bool display_frame(const uint8_t *frame) {
+
+  // a newer frame supersedes any pending one
+  pending_valid = false;
+
+  uint8_t first = 0;
+  uint8_t last = DISPLAY_DIGITS;
+
+  // narrow the write down to the range of changed bytes
+  if (shadow_valid) {
+    while (first < last && frame[first] == shadow[first]) first++;
+    while (last > first && frame[last - 1] == shadow[last - 1]) last--;
+  }
+
+  // nothing changed and no commands, skip the transaction entirely
+  if (first == last && commands_len == 0) {
+    display_bytes_skipped += DISPLAY_DIGITS;
+    return true;
+  }
+
+  // chain the queued commands in front of the changed digits,
+  // each DDRAM byte holds two 4-bit segment addresses
+  lcd_batch batch;
+  lcd_begin(&batch);
+  for (uint8_t i = 0; i < commands_len; i++) lcd_command(&batch, commands[i]);
+  if (first < last) lcd_data(&batch, first << 1, &frame[first], last - first);
+
+  // the i2c queue is full, keep the frame around until
+  // one of the queued transactions completes
+  if (!lcd_send(&batch)) {
+    for (uint8_t i = 0; i < DISPLAY_DIGITS; i++) pending[i] = frame[i];
+    pending_valid = true;
+    return false;
+  }
+  commands_len = 0;
+
+  // only update the shadow once the transaction was accepted
+  for (uint8_t i = first; i < last; i++) {
+    shadow[i] = frame[i];
+  }
+  shadow_valid = true;
+
+  display_bytes_sent += batch.length;
+  display_bytes_skipped += DISPLAY_DIGITS - (last - first);
+  return true;
+
+}
@@ -0,0 +1,30 @@
+// Shadowed LCD framebuffer with partial DDRAM updates
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lcddriver.h"
+
+// number of digit bytes in the lcd driver's DDRAM
+#define DISPLAY_DIGITS 4
+
+// commands that fit in front of a full frame in one transaction
+#define DISPLAY_COMMANDS (LCD_BATCH_LEN - 1 - DISPLAY_DIGITS)
+
+// statistics to measure the bus traffic saved by the shadow copy
+extern uint32_t display_bytes_sent;
+extern uint32_t display_bytes_skipped;
+
+void display_init();
+void display_event();
+void display_invalidate();
+void display_reset(lcd_power profile);
+void display_power(lcd_power profile);
+void display_blink(uint8_t rate);
+void display_command(uint8_t command);
+bool display_flush();
+bool display_frame(const uint8_t *frame);
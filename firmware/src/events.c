@@ -0,0 +1,87 @@
+// Events from the interrupts, handled in the main loop
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#include "events.h"
+#include "timers.h"
+#include "buttons.h"
+#include "battery.h"
+#include "storage.h"
+#include "display.h"
+#include "i2c_controller.h"
+
+/**
+ * The interrupt handlers only acknowledge their peripheral, keep the
+ * few bytes that cannot wait and post an event. The application runs
+ * in the main loop, which drains the queue after every wakeup before
+ * going back to sleep. All state of the timers, buttons and countdowns
+ * is therefore only touched from one context, and several events of
+ * one wakeup end up in a single update of the display.
+ *
+ * The queue is a ring with one producer, the interrupts, and one
+ * consumer, the main loop. Each index is only written by its side.
+ * The TWI host interrupt may preempt the others, see below, so a post
+ * is an atomic section of a few cycles. An event that is still queued
+ * is not posted again: the handlers look at the whole state of their
+ * peripheral, not at a single occurrence. So the ring can never
+ * overflow and a few slots suffice. The queued events are the bits of
+ * EVENT_FLAGS, and events_post() is inlined into the handlers, see
+ * events.h, so the short ones call no function at all.
+ **/
+
+_Static_assert(EVENT_SLOTS > events, "every event must fit into the ring at once");
+_Static_assert(events <= 8, "every event needs a bit in EVENT_FLAGS");
+
+volatile uint8_t events_ring[EVENT_SLOTS];
+static volatile uint8_t head = 0; // next to handle, main loop only
+volatile uint8_t events_tail = 0; // next free slot, interrupts only
+
+volatile uint16_t events_merged = 0;
+
+static void (*const handlers[events])() = {
+  [event_deadline] = deadline,
+  [event_buttons]  = buttons_event,
+  [event_battery]  = battery_event,
+  [event_brownout] = storage_event,
+  [event_display]  = display_event,
+  [event_target]   = i2c_target_event,
+};
+
+bool events_pending() {
+  return head != events_tail;
+}
+
+// handle everything that was posted, including events posted meanwhile;
+// returns false if there was nothing, e.g. after a byte on the bus
+bool events_dispatch() {
+  bool handled = false;
+  while (head != events_tail) {
+    handled = true;
+    event e = events_ring[head];
+    // posting the same event again is allowed from here on
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      EVENT_FLAGS &= ~(1 << e);
+    }
+    head = (head + 1) & (EVENT_SLOTS - 1);
+    handlers[e]();
+  }
+  return handled;
+}
+
+
+// ---------- priorities ---------- //
+
+/**
+ * The TWI host interrupt is the only one on level 1. It feeds the bus
+ * byte by byte and the bus, the lcd power-down and standby all wait
+ * for its stop condition, so it preempts any other handler. The rest
+ * share level 0 in round-robin order, so a source that keeps firing,
+ * e.g. the deadlines of a held button, cannot starve the others.
+ * The handlers themselves are a few dozen cycles since the work moved
+ * to the main loop; the atomic sections are the remaining delays.
+ **/
+
+void setup_interrupts() {
+  CPUINT.LVL1VEC = TWI0_TWIM_vect_num;
+  _PROTECTED_WRITE(CPUINT.CTRLA, CPUINT_LVL0RR_bm);
+}
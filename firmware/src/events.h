@@ -0,0 +1,50 @@
+// Events from the interrupts, handled in the main loop
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hal.h"
+#include "flags.h"
+
+// what an interrupt has to tell the main loop, one byte each
+typedef enum {
+  event_deadline = 0, // rtc compare match, see deadline()
+  event_buttons,      // pin change, see buttons_event()
+  event_battery,      // adc result, see battery_event()
+  event_brownout,     // supply below the level monitor, see storage_event()
+  event_display,      // i2c transaction complete, see display_event()
+  event_target,       // registers written by a remote host, see i2c_target_event()
+  events,
+} event;
+
+#define EVENT_SLOTS 8 // a power of two, more than events
+
+// the ring, only for events_post()
+extern volatile uint8_t events_ring[EVENT_SLOTS];
+extern volatile uint8_t events_tail;
+
+// posts that found the event already queued, e.g. a second edge
+extern volatile uint16_t events_merged;
+
+void setup_interrupts();
+bool events_pending();
+bool events_dispatch();
+
+// queue an event, only from interrupt handlers; inlined, so a handler
+// that does nothing else needs no call and saves few registers
+static inline void events_post(event e) {
+  uint8_t bit = 1 << e;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    if (EVENT_FLAGS & bit) {
+      events_merged++;
+    } else {
+      EVENT_FLAGS |= bit;
+      events_ring[events_tail] = e;
+      events_tail = (events_tail + 1) & (EVENT_SLOTS - 1);
+    }
+  }
+}
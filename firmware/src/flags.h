@@ -0,0 +1,42 @@
+// Flags in the general purpose I/O registers
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#pragma once
+
+#include "hal.h"
+
+/**
+ * GPIOR0..3 sit in the lowest part of the I/O space, so a constant bit
+ * in them is set, cleared or tested with a single sbi, cbi or sbis.
+ * Those are atomic and need no register, where a bool in SRAM is a
+ * load and a store through a register that the handler has to save.
+ * The flags that the interrupts and the main loop look at on every
+ * wakeup live here, one register per owner. Several bits at once are
+ * still a read-modify-write and need an atomic section like any other
+ * shared variable, so change them one statement per bit: the level 1
+ * TWI host handler may interrupt anything else that writes I2C_FLAGS.
+ **/
+
+// i2c_controller.c: the software state of both roles
+#define I2C_FLAGS GPIOR0
+#define I2C_ACTIVE     (1 << 0) // a queued write is on the bus
+#define I2C_STOPPING   (1 << 1) // stop condition requested, the bus is not idle yet
+#define I2C_TARGET     (1 << 2) // a remote host addressed us and did not stop yet
+#define I2C_ADDRESSING (1 << 3) // the next byte written is the register pointer
+#define I2C_SENDING    (1 << 4) // a byte was sent to the remote host since the address
+
+// events.c: events in the ring, one bit per event
+#define EVENT_FLAGS GPIOR1
+
+// buttons.c: pins that were muted since the last buttons_event()
+#define EDGE_FLAGS GPIOR2
+
+// the main loop and its modules
+#define MAIN_FLAGS GPIOR3
+#define MAIN_REDRAW       (1 << 0) // the shown steep changed, see draw_steep()
+#define MAIN_ASLEEP       (1 << 1) // display off after the auto-off
+#define MAIN_POWERED_DOWN (1 << 2) // lcd power cut, the cpu in power-down
+#define MAIN_NOTICING     (1 << 3) // the low battery message is shown
+#define MAIN_LCD_FAILED   (1 << 4) // a display transaction failed, see display.c
+#define MAIN_DEFERRED     (1 << 5) // a change waits to be saved, see storage.c
@@ -0,0 +1,44 @@
+// Segment font for text on the LCD
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#include "font.h"
+#include "display.h"
+
+#define GLYPH(c, segments) [(c) - FONT_FIRST] = (segments)
+
+const uint8_t FONT[FONT_LAST - FONT_FIRST + 1] = {
+  // numbers
+  GLYPH('0', CHAR_0), GLYPH('1', CHAR_1), GLYPH('2', CHAR_2), GLYPH('3', CHAR_3),
+  GLYPH('4', CHAR_4), GLYPH('5', CHAR_5), GLYPH('6', CHAR_6), GLYPH('7', CHAR_7),
+  GLYPH('8', CHAR_8), GLYPH('9', CHAR_9),
+  // symbols
+  GLYPH(' ', CHAR_SPACE), GLYPH('-', CHAR_MINUS), GLYPH('_', CHAR_UNDER),
+  GLYPH('>', CHAR_GREATER), GLYPH('<', CHAR_LESS), GLYPH('=', CHAR_EQUAL),
+  GLYPH('\'', CHAR_PRIME),
+  // alphabet
+  GLYPH('A', CHAR_A), GLYPH('a', CHAR_a), GLYPH('B', CHAR_B), GLYPH('b', CHAR_b),
+  GLYPH('C', CHAR_C), GLYPH('c', CHAR_c), GLYPH('D', CHAR_D), GLYPH('d', CHAR_d),
+  GLYPH('E', CHAR_E), GLYPH('e', CHAR_e), GLYPH('F', CHAR_F), GLYPH('f', CHAR_f),
+  GLYPH('G', CHAR_G), GLYPH('g', CHAR_g), GLYPH('H', CHAR_H), GLYPH('h', CHAR_h),
+  GLYPH('I', CHAR_I), GLYPH('i', CHAR_i), GLYPH('J', CHAR_J), GLYPH('j', CHAR_j),
+  GLYPH('K', CHAR_K), GLYPH('k', CHAR_k), GLYPH('L', CHAR_L), GLYPH('l', CHAR_l),
+  GLYPH('N', CHAR_N), GLYPH('n', CHAR_n), GLYPH('O', CHAR_O), GLYPH('o', CHAR_o),
+  GLYPH('P', CHAR_P), GLYPH('p', CHAR_p), GLYPH('Q', CHAR_Q), GLYPH('q', CHAR_q),
+  GLYPH('R', CHAR_R), GLYPH('r', CHAR_r), GLYPH('S', CHAR_S), GLYPH('s', CHAR_s),
+  GLYPH('T', CHAR_T), GLYPH('t', CHAR_t), GLYPH('U', CHAR_U), GLYPH('u', CHAR_u),
+  GLYPH('V', CHAR_V), GLYPH('v', CHAR_v), GLYPH('X', CHAR_X), GLYPH('x', CHAR_x),
+  GLYPH('Y', CHAR_Y), GLYPH('y', CHAR_y), GLYPH('Z', CHAR_Z), GLYPH('z', CHAR_z),
+};
+
+// turn four characters, left to right, into a frame for display_frame();
+// the first DDRAM byte is the rightmost digit and the point segment of
+// each digit is the mark to its right, e.g. FONT_COLON after the second
+void font_render(uint8_t *frame, const char *text, uint8_t dots) {
+  for (uint8_t i = 0; i < DISPLAY_DIGITS; i++) {
+    uint8_t c = text[i];
+    uint8_t glyph = (c >= FONT_FIRST && c <= FONT_LAST) ? FONT[c - FONT_FIRST] : CHAR_SPACE;
+    if (dots & FONT_DOT(i)) glyph |= CHAR_POINT;
+    frame[DISPLAY_DIGITS - 1 - i] = glyph;
+  }
+}
@@ -0,0 +1,32 @@
+// Segment font for text on the LCD
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#pragma once
+
+#include <stdint.h>
+
+#include "segments.h"
+
+/**
+ * FONT maps the printable ASCII characters to their segments, built
+ * from the CHAR_* definitions at compile time. It is const, so on the
+ * ATtiny417 it stays in the flash, which is mapped into the data space
+ * and read with a plain load; no SRAM is used. Characters without a
+ * glyph are blank, e.g. 'M' and 'W', which take two digits: see
+ * CHAR_Ml and CHAR_Mr.
+ **/
+
+#define FONT_FIRST ' '
+#define FONT_LAST  'z'
+
+extern const uint8_t FONT[FONT_LAST - FONT_FIRST + 1];
+
+// the digits 0 to 9
+#define NUMBERS (&FONT['0' - FONT_FIRST])
+
+// a point or the colon after the n-th character from the left, see font_render()
+#define FONT_DOT(n) (1 << (n))
+#define FONT_COLON FONT_DOT(1)
+
+void font_render(uint8_t *frame, const char *text, uint8_t dots);
@@ -0,0 +1,33 @@
+// Thin hardware abstraction for the target and the host simulator
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#pragma once
+
+/**
+ * All modules reach the peripherals only through the register
+ * definitions and the few core functions included here:
+ * 
+ *   - peripheral register structs (TWI0, RTC, PORTB, SLPCTRL, ...)
+ *   - ISR(), sei(), cli(), sleep_cpu()
+ *   - ATOMIC_BLOCK() and _PROTECTED_WRITE()
+ * 
+ * On the target these are simply avr-libc's headers. When building
+ * the simulator with -D SIMULATOR they are replaced by the register
+ * model in sim/device.h, so the unchanged firmware runs on the host
+ * against simulated peripherals; see sim/sim.c.
+ * 
+ **/
+
+#ifndef SIMULATOR
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+
+#else
+
+#include "sim/device.h"
+
+#endif
@@ -1,22 +1,79 @@
-// Use 1-series TWI for I2C controller communications.
+// Use 1-series TWI for I2C controller and target communications.
 // Copyright (c) 2022 Anton Semjonov
 // Licensed under the MIT License
 
+#include <string.h>
+
+#include "hal.h"
 #include "i2c_controller.h"
 #include "sleepmode.h"
+#include "oscillators.h"
+#include "events.h"
+#include "profile.h"
+#include "clock.h"
+#include "flags.h"
+#include "trace.h"
+
+/**
+ * The bus is shared between the lcd driver and the external connector,
+ * so the TWI works in both roles. As a host, it sends the queued writes
+ * to the lcd whenever the bus is free. Another host on the connector
+ * may start at the same time: the one with the lower address wins the
+ * arbitration and the other one waits for the stop condition. A lost
+ * transaction is therefore started again, up to I2C_RETRIES times.
+ *
+ * As a target, it answers at I2C_TARGET_ADDRESS with a register map of
+ * I2C_REGISTERS bytes. The first byte written sets the register pointer,
+ * further bytes are written from there on and reads continue from there
+ * as well. Reads are served from a copy taken at the address match, so
+ * the values of one transaction never tear. Writes are handed to the
+ * main loop with event_target at the stop condition. A read-only window
+ * of RAM may follow the map, e.g. a diagnostic buffer; it is read live
+ * without a copy, see i2c_target_window(). The address match
+ * wakes the cpu from any sleep mode, but the data bytes need the
+ * peripheral clock, so the cpu sleeps in idle until the stop.
+ **/
 
 
 // ---------- init and basics ---------- //
 
-// TODO: use a single bitfield "register"?
 i2c_error i2c_result = success;
 
-// hold current and end pointers
-static volatile uint8_t *buf = NULL;
-static volatile uint8_t *end = NULL;
+// the state of both roles in software is in I2C_FLAGS, see flags.h;
+// neither I2C_ACTIVE nor I2C_STOPPING means the bus was released
+
+// a queued write transaction
+typedef struct {
+  uint8_t address;
+  uint8_t length;
+  const uint8_t *data; // external buffer or NULL if stored inline
+  uint8_t bytes[I2C_INLINE_LEN];
+} i2c_transaction;
+
+// ring buffer of transactions, the head is the one on the bus
+static i2c_transaction queue[I2C_QUEUE_LEN];
+static volatile uint8_t queue_head = 0;
+static volatile uint8_t queue_count = 0;
+
+// queue statistics
+volatile uint8_t  i2c_queue_highwater = 0;
+volatile uint16_t i2c_dropped = 0;
+volatile uint16_t i2c_failed = 0;
+
+volatile uint16_t i2c_retried = 0;
+
+// current and end pointers, valid with I2C_ACTIVE
+static uint8_t *buf = NULL;
+static uint8_t *end = NULL;
 
-// save the previous sleep controller state
-static volatile uint8_t sleepmode = 0x00;
+// attempts of the transaction at the head of the queue
+static uint8_t attempts = 0;
+
+// a remote host addressed us at this time, see I2C_TARGET
+static uint16_t target_since = 0;
+
+// optional notification about completed transactions
+static i2c_callback on_complete = NULL;
 
 
 // configure the twi controller for interrupt-driven operation
@@ -28,7 +85,8 @@ void i2c_init() {
   #endif
 
   // set the calculated baudrate
-  TWI0.MBAUD = TWI_BAUD;
+  int32_t baud = TWI_BAUD(clock_hz());
+  TWI0.MBAUD = baud > 0 ? baud : 0;
 
   // enable peripheral in "master" mode
   TWI0.MCTRLA = \
@@ -39,89 +97,230 @@ void i2c_init() {
   // force the bus state into IDLE
   TWI0.MSTATUS = TWI_BUSSTATE_IDLE_gc;
 
+  #if I2C_TARGET_ADDRESS
+  // answer as a target, with interrupts for the address, data and stop
+  TWI0.SADDR = I2C_TARGET_ADDRESS << 1;
+  TWI0.SCTRLA = TWI_DIEN_bm | TWI_APIEN_bm | TWI_PIEN_bm | TWI_ENABLE_bm;
+  #endif
+
 }
 
-// begin a transaction by writing an address with direction bit
+// the cpu clock has changed, the baud rate is only written while disabled
+void i2c_retime() {
+  if (!(TWI0.MCTRLA & TWI_ENABLE_bm)) return;
+  TWI0.MCTRLA = 0;
+  i2c_init();
+}
+
+// switch both roles off, e.g. before the bus loses its pullups;
+// call i2c_init() again before the next transaction
+void i2c_disable() {
+  TWI0.MCTRLA = 0;
+  TWI0.SCTRLA = 0;
+  I2C_FLAGS &= ~I2C_TARGET;
+}
+
+// end the transfer on our side and wait for the next start condition
+static void target_release() {
+  TWI0.SCTRLB = TWI_SCMD_COMPTRANS_gc;
+  I2C_FLAGS &= ~I2C_TARGET;
+}
+
+// register a function to be called after each transaction
+void i2c_on_complete(i2c_callback callback) {
+  on_complete = callback;
+}
+
+// check the hardware bus state, not just the software state: the stop
+// condition is still going out as long as the bus is ours
+static inline bool bus_owned() {
+  return (TWI0.MSTATUS & TWI_BUSSTATE_gm) == TWI_BUSSTATE_OWNER_gc;
+}
+
+// begin a transaction by writing an address with direction bit,
+// this is a repeated start if we still own the bus
 void i2c_start(uint8_t address, bool reading) {
 
   // write the address
   TWI0.MADDR = address << 1 | (reading ? 1 : 0);
 
-  // configure idle sleep mode (so peripherals remain active)
-  sleepmode = SLPCTRL.CTRLA;
-  sleep_configure_idle();
+}
+
+// put the transaction at the head of the queue on the bus
+static void i2c_next() {
+
+  i2c_transaction *t = &queue[queue_head];
+  buf = (t->data != NULL) ? (uint8_t *)t->data : t->bytes;
+  end = buf + t->length;
+  i2c_result = in_progress;
+  I2C_FLAGS &= ~I2C_STOPPING;
+  I2C_FLAGS |= I2C_ACTIVE;
+  i2c_start(t->address, false);
 
 }
 
-// clear buffers and end a transaction "in software"
-void i2c_end(i2c_error err) {
+// remove the head of the queue and notify the caller
+static void i2c_complete(i2c_error err) {
 
-  // store transaction result and clear pointers
   i2c_result = err;
-  buf = end = NULL;
+  trace(trace_i2c, err);
+  if (err != success) i2c_failed++;
+  attempts = 0;
+  queue_head = (queue_head + 1) % I2C_QUEUE_LEN;
+  queue_count--;
+
+  // this may queue another transaction
+  if (on_complete != NULL) on_complete(err);
+
+}
 
-  // restore previous sleep mode
-  SLPCTRL.CTRLA = sleepmode;
+// end a transaction "in software", the pointers are invalid from here
+void i2c_end() {
+
+  I2C_FLAGS &= ~I2C_ACTIVE;
+  I2C_FLAGS &= ~I2C_STOPPING;
 
 }
 
-// stop a transaction by generating a stop condition
+// request a stop condition on the bus but don't wait for it,
+// the transaction is ended in i2c_poll() once the bus is idle
 void i2c_stop() {
 
-  // generate the stop condition on the bus and wait for idle
   TWI0.MCTRLB |= TWI_MCMD_STOP_gc;
-  // TODO: we don't want busy waiting in an ISR, do we?
-  while (!(TWI0.MSTATUS & TWI_BUSSTATE_IDLE_gc));
+  I2C_FLAGS &= ~I2C_ACTIVE;
+  I2C_FLAGS |= I2C_STOPPING;
+
+}
+
+// continue with the next transaction or release the bus
+static void i2c_continue() {
+  if (queue_count > 0) {
+    i2c_next();
+  } else {
+    i2c_end();
+  }
+}
+
+// end a stopping transaction once the stop condition went out;
+// returns true while it is still pending, which takes a few cycles.
+// Another host may take the bus right after it: the next start then
+// waits for the bus to become idle in the controller, and the cpu
+// sleeps in idle until its interrupt instead of spinning here
+// note: call with interrupts disabled, e.g. right before sleeping
+bool i2c_poll() {
+
+  // a host that went away in the middle of a transfer never sends the
+  // stop, which would keep the cpu in idle
+  if ((I2C_FLAGS & I2C_TARGET) && (uint16_t)(rtc_time() - target_since) > I2C_TARGET_TIMEOUT) {
+    target_release();
+  }
+
+  if (!(I2C_FLAGS & I2C_STOPPING)) return false;
+  if (bus_owned()) return true;
+  i2c_continue();
+  return false;
 
 }
 
-// busy-wait for a transaction to finish
+// sleep until all queued transactions have finished
 void i2c_wait_until_idle() {
-  while (!(TWI0.MSTATUS & TWI_BUSSTATE_IDLE_gc));
+  for (;;) {
+    cli();
+    bool pending = i2c_poll();
+    if (!(I2C_FLAGS & (I2C_ACTIVE | I2C_STOPPING))) break;
+    if (pending) {
+      // the stop condition only takes a few cycles
+      sei();
+      continue;
+    }
+    // woken by the next twi interrupt
+    // note: sei() is delayed by one instruction, so no interrupt is missed
+    sleep_cpu_idle();
+  }
+  sei();
+}
+
+// check if transactions are queued, the bus is still in use or a
+// remote host is in the middle of a transfer with us
+bool i2c_busy() {
+  return I2C_FLAGS & (I2C_ACTIVE | I2C_STOPPING | I2C_TARGET);
 }
 
 
 // ---------- writing ---------- //
 
+// queue a write transaction, returns false if the queue is full
 bool i2c_write(uint8_t address, const uint8_t *data, const uint8_t length) {
 
-  // abort if another transmission is already running
-  if (buf != NULL) return false;
+  bool queued = false;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
 
-  // also abort if bus state is not currently idle
-  if (!(TWI0.MSTATUS & TWI_BUSSTATE_IDLE_gc)) return false;
+    // count the transaction as dropped if there's no room left
+    if (queue_count >= I2C_QUEUE_LEN) {
+      i2c_dropped++;
+    } else {
 
-  // otherwise start a transmission, store pointer and length
-  buf = data;
-  end = data + length;
+      // short transactions are copied, so the caller can reuse its buffer
+      i2c_transaction *t = &queue[(queue_head + queue_count) % I2C_QUEUE_LEN];
+      t->address = address;
+      t->length = length;
+      if (length <= I2C_INLINE_LEN) {
+        memcpy(t->bytes, data, length);
+        t->data = NULL;
+      } else {
+        t->data = data;
+      }
+      queue_count++;
+      if (queue_count > i2c_queue_highwater) i2c_queue_highwater = queue_count;
+      queued = true;
+
+      // start right away if the bus is ours to take,
+      // otherwise it is chained after the current transaction
+      if (!(I2C_FLAGS & (I2C_ACTIVE | I2C_STOPPING))) {
+        i2c_next();
+      }
 
-  // write address and configure sleep mode
-  i2c_start(address, false);
+    }
+  }
+  return queued;
 
 }
 
 // ---------- interrupt handler ---------- //
 
 ISR(TWI0_TWIM_vect) {
-
-  // error: arbitration lost or bus error
-  if (TWI0.MSTATUS & (TWI_ARBLOST_bm | TWI_BUSERR_bm)) {
-    i2c_end(arbitration_lost);
+  profile_isr(profile_twi);
+
+  uint8_t status = TWI0.MSTATUS;
+
+  // error: arbitration lost or bus error, the bus is not ours to stop;
+  // start over, the controller waits until the bus is idle again
+  if (status & (TWI_ARBLOST_bm | TWI_BUSERR_bm)) {
+    TWI0.MSTATUS = TWI_ARBLOST_bm | TWI_BUSERR_bm;
+    if (I2C_FLAGS & I2C_ACTIVE) {
+      if (++attempts <= I2C_RETRIES) {
+        i2c_retried++;
+        i2c_next();
+      } else {
+        i2c_complete(arbitration_lost);
+        i2c_continue();
+      }
+    }
+    return;
   }
 
+  // nothing of ours on the bus, e.g. the stop condition went out
+  if (!(I2C_FLAGS & I2C_ACTIVE)) return;
+
   // error: no such address
-  if (TWI0.MSTATUS & TWI_RXACK_bm) {
+  if (status & TWI_RXACK_bm) {
+    i2c_complete(address_nack);
     i2c_stop();
-    i2c_end(address_nack);
-  }
-
-  // error: pointers are not set ?!
-  if ((buf == NULL) || (end == NULL)) {
-    return; // ?!
+    return;
   }
 
   // WIF --> write interrupt
-  if (TWI0.MSTATUS & TWI_WIF_bm) {
+  if (status & TWI_WIF_bm) {
 
     // if there is data remaining ...
     if (buf < end) {
@@ -132,15 +331,20 @@ ISR(TWI0_TWIM_vect) {
 
     } else {
 
-      // end the transaction
-      i2c_stop();
-      i2c_end(success);
+      // chain the next transaction with a repeated start
+      // or end with a stop condition
+      i2c_complete(success);
+      if (queue_count > 0) {
+        i2c_next();
+      } else {
+        i2c_stop();
+      }
 
     }
   }
 
   // RIF --> read interrupt // TODO: untested
-  if (TWI0.MSTATUS & TWI_RIF_bm) {
+  if (status & TWI_RIF_bm) {
 
     // if more data is to be read ...
     if (buf < end) {
@@ -159,8 +363,8 @@ ISR(TWI0_TWIM_vect) {
 
       // send a NACK and stop
       TWI0.MCTRLB = TWI_ACKACT_NACK_gc;
+      i2c_complete(success);
       i2c_stop();
-      i2c_end(success);
 
     }
 
@@ -169,3 +373,121 @@ ISR(TWI0_TWIM_vect) {
 }
 
 
+// ---------- target ---------- //
+
+// register map as published by the application, and the copy that is
+// read out during one transaction
+static uint8_t registers[I2C_REGISTERS];
+static uint8_t snapshot[I2C_REGISTERS];
+
+// registers written by the remote host, until i2c_target_event()
+static uint8_t inbox[I2C_REGISTERS];
+static volatile uint16_t written = 0;
+
+static uint8_t pointer = 0; // register of the next byte
+
+// read-only bytes after the map, from register I2C_REGISTERS on
+static const volatile uint8_t *window = NULL;
+static uint8_t window_length = 0;
+
+_Static_assert(I2C_REGISTERS <= 16 && (I2C_REGISTERS & (I2C_REGISTERS - 1)) == 0,
+  "the register map must fit the written bitmask and wrap around");
+
+// update registers of the map, from the main loop
+void i2c_target_set(uint8_t reg, const uint8_t *data, uint8_t length) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    memcpy(&registers[reg], data, length);
+  }
+}
+
+// show bytes of ram after the register map, they are read as they are
+void i2c_target_window(const volatile void *data, uint8_t length) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    window = data;
+    window_length = length;
+  }
+}
+
+// the register after the current one, reads wrap around after the window
+static inline void advance() {
+  if (++pointer >= I2C_REGISTERS + window_length) pointer = 0;
+}
+
+// hand the written registers to the application, see event_target
+void i2c_target_event() {
+  uint16_t bits;
+  uint8_t values[I2C_REGISTERS];
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    bits = written;
+    written = 0;
+    memcpy(values, inbox, sizeof(values));
+  }
+  for (uint8_t reg = 0; reg < I2C_REGISTERS; reg++) {
+    if (bits & (1 << reg)) i2c_target_written(reg, values[reg]);
+  }
+}
+
+ISR(TWI0_TWIS_vect) {
+  profile_isr(profile_twis);
+
+  uint8_t status = TWI0.SSTATUS;
+
+  // error: collision or bus error, the host starts over
+  if (status & (TWI_COLL_bm | TWI_BUSERR_bm)) {
+    TWI0.SSTATUS = TWI_COLL_bm | TWI_BUSERR_bm;
+    target_release();
+    return;
+  }
+
+  // address match or stop condition
+  if (status & TWI_APIF_bm) {
+    if (!(status & TWI_AP_bm)) {
+      target_release();
+      if (written) events_post(event_target);
+      return;
+    }
+    // only the address match is traced, not every byte
+    trace(trace_isr, profile_twis);
+    if (!(I2C_FLAGS & I2C_TARGET)) target_since = rtc_time();
+    I2C_FLAGS |= I2C_TARGET;
+    // one bit per statement, a single cbi each: the host handler on
+    // level 1 may change the other bits of I2C_FLAGS meanwhile
+    I2C_FLAGS &= ~I2C_ADDRESSING;
+    I2C_FLAGS &= ~I2C_SENDING;
+    if (!(status & TWI_DIR_bm)) I2C_FLAGS |= I2C_ADDRESSING;
+    if (status & TWI_DIR_bm) memcpy(snapshot, registers, sizeof(snapshot));
+    TWI0.SCTRLB = TWI_ACKACT_ACK_gc | TWI_SCMD_RESPONSE_gc;
+    return;
+  }
+
+  if (!(status & TWI_DIF_bm)) return;
+
+  // the host reads and ends with a nack after its last byte
+  if (status & TWI_DIR_bm) {
+    if ((I2C_FLAGS & I2C_SENDING) && (status & TWI_RXACK_bm)) {
+      TWI0.SCTRLB = TWI_SCMD_COMPTRANS_gc;
+      return;
+    }
+    TWI0.SDATA = pointer < I2C_REGISTERS ? snapshot[pointer] : window[pointer - I2C_REGISTERS];
+    advance();
+    I2C_FLAGS |= I2C_SENDING;
+    TWI0.SCTRLB = TWI_SCMD_RESPONSE_gc;
+    return;
+  }
+
+  // the host writes, first the pointer and then the registers
+  uint8_t data = TWI0.SDATA;
+  if (I2C_FLAGS & I2C_ADDRESSING) {
+    pointer = data < I2C_REGISTERS + window_length ? data : data & (I2C_REGISTERS - 1);
+    I2C_FLAGS &= ~I2C_ADDRESSING;
+  } else {
+    // the window is read-only
+    if (pointer < I2C_REGISTERS) {
+      inbox[pointer] = data;
+      written |= 1 << pointer;
+    }
+    advance();
+  }
+  TWI0.SCTRLB = TWI_ACKACT_ACK_gc | TWI_SCMD_RESPONSE_gc;
+
+}
@@ -1,4 +1,4 @@
-// Use 1-series TWI for I2C controller communications.
+// Use 1-series TWI for I2C controller and target communications.
 // Copyright (c) 2022 Anton Semjonov
 // Licensed under the MIT License
 
@@ -7,8 +7,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
-#include <avr/io.h>
-#include <avr/interrupt.h>
+
+#include "hal.h"
 
 
 // use fast mode with 400 khz
@@ -17,18 +17,38 @@
 // rise time from datasheet, table 34-19 (t_R)
 #define T_RISE 300L // [ns]
 
-// calculate controller baud rate
+// calculate controller baud rate for the current cpu clock, see clock.h
 //      f_scl = f_cpu / (10 + 2·BAUD + f_cpu·t_rise)
 //  --> 10 + 2·BAUD + f_cpu·t_rise = f_cpu/f_scl
 //  --> BAUD = ( f_cpu/f_scl - f_cpu·t_rise - 10 ) / 2
-#define TWI_BAUD ( (F_CPU/F_SCL) - (F_CPU*T_RISE/1000000000) - 10 ) / 2
+// rounded up so the bus is never faster than F_SCL; at slow clocks the
+// baud rate reaches zero and the bus gets slower than F_SCL instead
+#define TWI_BAUD(f_cpu) ( (int32_t)(((f_cpu) + F_SCL - 1) / F_SCL) - (int32_t)((f_cpu) / 1000 * T_RISE / 1000000) - 9 ) / 2
+
+
+// number of transactions that can be queued
+#define I2C_QUEUE_LEN 4
+
+// transactions up to this length are copied into the queue,
+// longer buffers are referenced and must remain valid until sent
+#define I2C_INLINE_LEN 8
+
+// a transaction that lost the arbitration is started again this often
+#define I2C_RETRIES 3
+
+// address as a target on the external connector, override with -D;
+// zero disables the target role
+#ifndef I2C_TARGET_ADDRESS
+#define I2C_TARGET_ADDRESS 0x30
+#endif
 
+// size of the register map in the target role, a power of two
+#define I2C_REGISTERS 16
+
+// a remote transfer without a stop condition is dropped after this
+// long in 1/1024 seconds, see rtc_time()
+#define I2C_TARGET_TIMEOUT 100
 
-// bitmap of status register // TODO
-#define I2C_IN_PROGRESS (1 << 0) // a transaction has been started in software
-#define I2C_START_OK    (1 << 1) // start condition sent and address was acknowleged
-#define I2C_BUS_ERROR   (1 << 2) // either arbitration was lost or another bus error
-#define I2C_NACKED      (1 << 3) // device sent back a NACK, either unsuccessful write or no more read
 
 typedef enum {
   success = 0,
@@ -37,8 +57,29 @@ typedef enum {
   address_nack,
 } i2c_error;
 
-i2c_error i2c_result;
+extern i2c_error i2c_result;
+
+// queue statistics
+extern volatile uint8_t  i2c_queue_highwater; // most transactions queued at once
+extern volatile uint16_t i2c_dropped;         // writes rejected because the queue was full
+extern volatile uint16_t i2c_failed;          // transactions ended with an error
+extern volatile uint16_t i2c_retried;         // transactions started again after a lost arbitration
+
+// called with the result once a transaction has completed
+typedef void (*i2c_callback)(i2c_error result);
 
 void i2c_init();
+void i2c_retime();
+void i2c_disable();
+void i2c_on_complete(i2c_callback callback);
 void i2c_wait_until_idle();
+bool i2c_poll();
+bool i2c_busy();
 bool i2c_write(uint8_t address, const uint8_t *buf, const uint8_t len);
+
+void i2c_target_set(uint8_t reg, const uint8_t *data, uint8_t length);
+void i2c_target_window(const volatile void *data, uint8_t length);
+void i2c_target_event();
+
+// called from the main loop with each register the remote host wrote
+extern void i2c_target_written(uint8_t reg, uint8_t value);
@@ -2,23 +2,105 @@
 // Copyright (c) 2022 Anton Semjonov
 // Licensed under the MIT License
 
-#include <avr/io.h>
-
+#include "hal.h"
 #include "lcddriver.h"
+#include "i2c_controller.h"
+
 
+// voltage on VLCD, kept across power cycles
+static uint8_t contrast = LCD_VLCD;
 
 // configure i2c pins and power on the chip
 void setup_lcddriver() {
 
-  // enable i2c pullups
-  PORTB.PIN0CTRL = PORT_PULLUPEN_bm;
-  PORTB.PIN1CTRL = PORT_PULLUPEN_bm;
-
-  // power on the chip
+  // drive the supply pins
   PORTA.DIRSET = \
-    PIN6_bm  // LCD_VLCD // TODO: use DAC output
+    PIN6_bm  // LCD_VLCD, or the DAC output
   | PIN7_bm; // LCD_VDD
   PORTA.OUTCLR = PIN6_bm; // VLCD low
+
+  lcd_power_on();
+
+}
+
+// enable i2c pullups and power the chip, it needs a software reset afterwards
+void lcd_power_on() {
+  PORTB.PIN0CTRL = PORT_PULLUPEN_bm;
+  PORTB.PIN1CTRL = PORT_PULLUPEN_bm;
   PORTA.OUTSET = PIN7_bm; // VDD high
+  lcd_contrast(contrast);
+}
+
+// cut the chip's supply, the pullups would otherwise power it through the
+// bus pins; disable the twi controller before calling this
+void lcd_power_off() {
+  DAC0.CTRLA = 0;
+  PORTA.PIN6CTRL = 0;
+  PORTA.OUTCLR = PIN7_bm; // VDD low
+  PORTB.PIN0CTRL = PORT_ISC_INPUT_DISABLE_gc;
+  PORTB.PIN1CTRL = PORT_ISC_INPUT_DISABLE_gc;
+}
+
+// set the lcd drive voltage, see LCD_VLCD
+void lcd_contrast(uint8_t vlcd) {
+  contrast = vlcd;
+  if (vlcd == 0) {
+    // full contrast with VLCD on ground, no DAC needed
+    DAC0.CTRLA = 0;
+    PORTA.PIN6CTRL = 0;
+    return;
+  }
+  // the DAC overrides the pin, whose input buffer would only draw current
+  PORTA.PIN6CTRL = PORT_ISC_INPUT_DISABLE_gc;
+  VREF.CTRLA = (VREF.CTRLA & ~VREF_DAC0REFSEL_gm) | VREF_DAC0REFSEL_1V5_gc;
+  DAC0.DATA = vlcd;
+  DAC0.CTRLA = DAC_RUNSTDBY_bm | DAC_OUTEN_bm | DAC_ENABLE_bm;
+}
+
+// display control commands of the power profiles
+static const uint8_t disctl[lcd_power_profiles] = {
+  [lcd_power_low] = LCD_DISCTL_cmd | LCD_DISCTL_framerate_50Hz
+    | LCD_DISCTL_waveform_frameinv | LCD_DISCTL_powersave_psm1,
+  [lcd_power_alarm] = LCD_DISCTL_cmd | LCD_DISCTL_framerate_80Hz
+    | LCD_DISCTL_waveform_lineinv | LCD_DISCTL_powersave_norm,
+};
+
+uint8_t lcd_disctl(lcd_power profile) {
+  return disctl[profile];
+}
+
+
+// ---------- chained commands ---------- //
+
+// start an empty transaction
+void lcd_begin(lcd_batch *batch) {
+  batch->length = 0;
+  batch->data = false;
+}
+
+// append a command, marking the previous one with CMDBIT so the
+// controller interprets the next byte as a command again
+bool lcd_command(lcd_batch *batch, uint8_t command) {
+  if (batch->data || batch->length >= LCD_BATCH_LEN) return false;
+  if (batch->length > 0) batch->bytes[batch->last] |= CMDBIT;
+  batch->last = batch->length;
+  batch->bytes[batch->length++] = command & ~CMDBIT;
+  return true;
+}
+
+// append the address setting and DDRAM data, this ends the command chain
+bool lcd_data(lcd_batch *batch, uint8_t address, const uint8_t *data, uint8_t length) {
+  if (batch->length + 1 + length > LCD_BATCH_LEN) return false;
+  if (!lcd_command(batch, address & LCD_ADSET_mask)) return false;
+  for (uint8_t i = 0; i < length; i++) {
+    batch->bytes[batch->length++] = data[i];
+  }
+  batch->data = true;
+  return true;
+}
 
+// queue the whole batch as one i2c transaction
+bool lcd_send(lcd_batch *batch) {
+  if (batch->length == 0) return true;
+  return i2c_write(LCD_ADDRESS, batch->bytes, batch->length);
 }
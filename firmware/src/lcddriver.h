@@ -67,4 +67,50 @@
 #define LCD_APCTL_APOFF_allOFF 0b1 << 0 // force all pixels OFF
 
 
-void setup_lcddriver();
\ No newline at end of file
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Power profiles for the display control command. After a reset the
+ * controller runs at 80 Hz with line inversion and in normal power
+ * mode. The low profile halves the drive current and lowers the frame
+ * rate, which is enough for a static display. The alarm profile keeps
+ * the default drive for crisp blinking.
+ **/
+typedef enum {
+  lcd_power_low = 0, // psm1 (x0.5), 50 Hz, frame inversion
+  lcd_power_alarm,   // normal (x1.0), 80 Hz, line inversion
+  lcd_power_profiles,
+} lcd_power;
+
+// display control command for a power profile
+uint8_t lcd_disctl(lcd_power profile);
+
+// voltage on VLCD through the DAC, in steps of 1.5 V / 256; the segments
+// are driven with VDD - VLCD, so higher values lower the contrast. Zero
+// drives the pin low instead and keeps the DAC off, which saves its
+// current in standby. Override with -D LCD_VLCD=...
+#ifndef LCD_VLCD
+#define LCD_VLCD 0
+#endif
+
+// longest chained transaction: a few commands, the address setting and four digits
+#define LCD_BATCH_LEN 8
+
+// builder for a single transaction with chained commands and DDRAM data
+typedef struct {
+  uint8_t length;   // number of bytes used
+  uint8_t last;     // index of the last command byte
+  bool    data;     // data was appended, no more commands possible
+  uint8_t bytes[LCD_BATCH_LEN];
+} lcd_batch;
+
+void setup_lcddriver();
+void lcd_power_on();
+void lcd_power_off();
+void lcd_contrast(uint8_t vlcd);
+
+void lcd_begin(lcd_batch *batch);
+bool lcd_command(lcd_batch *batch, uint8_t command);
+bool lcd_data(lcd_batch *batch, uint8_t address, const uint8_t *data, uint8_t length);
+bool lcd_send(lcd_batch *batch);
\ No newline at end of file
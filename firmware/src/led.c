@@ -0,0 +1,52 @@
+// Configure and control the LED on pin A5
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#include "led.h"
+#include "oscillators.h"
+#include "clock.h"
+
+/**
+ * The alarm pattern runs without the cpu: the PIT sends an event four
+ * times per second through the asynchronous event channel 3, and each
+ * event starts TCB0 in single-shot mode. Its waveform output on PA5 is
+ * high until the counter reaches CCMP, which overrides the port pin.
+ *
+ * TCB0 keeps running in standby, which requests the peripheral clock
+ * and keeps the 20 MHz oscillator on during the alarm. That is still a
+ * fraction of the steady LED current, but with a low battery teatime.c
+ * flashes the LED from the RTC deadlines instead. The LCD blinks from
+ * its own oscillator, so the pulses are not locked to its phase.
+ **/
+
+static uint16_t pulse = 0;
+
+// TCB0 counts at CLK_PER / 2, which depends on the clock point
+static uint16_t pulse_ticks(uint16_t us) {
+  return (uint32_t)us * (clock_hz() / 2000) / 1000;
+}
+
+// start the pulse pattern, or change the pulse length
+void led_alarm(uint16_t pulse_us) {
+  run_pit();
+  pulse = pulse_us;
+  EVSYS.ASYNCCH3 = EVSYS_ASYNCCH3_PIT_DIV8192_gc;
+  EVSYS.ASYNCUSER0 = EVSYS_ASYNCUSER0_ASYNCCH3_gc;
+  TCB0.CCMP = pulse_ticks(pulse_us);
+  TCB0.EVCTRL = TCB_CAPTEI_bm;
+  TCB0.CTRLB = TCB_CCMPEN_bm | TCB_CNTMODE_SINGLE_gc;
+  TCB0.CTRLA = TCB_RUNSTDBY_bm | TCB_CLKSEL_CLKDIV2_gc | TCB_ENABLE_bm;
+}
+
+// stop the pattern and give the pin back to the port, which is low
+void led_alarm_off() {
+  TCB0.CTRLA = 0;
+  TCB0.CTRLB = 0;
+  EVSYS.ASYNCUSER0 = EVSYS_ASYNCUSER0_OFF_gc;
+  led_off();
+}
+
+// keep the pulse length after the clock has changed
+void led_retime() {
+  if (TCB0.CTRLA & TCB_ENABLE_bm) TCB0.CCMP = pulse_ticks(pulse);
+}
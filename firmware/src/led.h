@@ -4,10 +4,22 @@
 
 #pragma once
 
-#include <avr/io.h>
+#include <stdint.h>
+
+#include "hal.h"
 
 
 #define setup_led()   PORTA.DIRSET = PIN5_bm // configure the LED pin as an output
 #define led_toggle()  PORTA.OUTTGL = PIN5_bm // toggle the LED
 #define led_on()      PORTA.OUTSET = PIN5_bm // turn the LED on
-#define led_off()     PORTA.OUTCLR = PIN5_bm // turn the LED off
\ No newline at end of file
+#define led_off()     PORTA.OUTCLR = PIN5_bm // turn the LED off
+
+// length of the alarm pulses in microseconds, up to 13 ms; the
+// brightness follows the duty cycle at four pulses per second
+#ifndef LED_ALARM_US
+#define LED_ALARM_US 12000
+#endif
+
+void led_alarm(uint16_t pulse_us);
+void led_alarm_off();
+void led_retime();
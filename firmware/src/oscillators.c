@@ -1,26 +1,23 @@
-// Configure the ATtiny417 system clock and RTC
+// Configure the ATtiny417 crystal and RTC
 // Copyright (c) 2022 Anton Semjonov
 // Licensed under the MIT License
 
 #include "oscillators.h"
+#include "events.h"
+#include "trace.h"
+#include "profile.h"
 
 
-// use internal oscillator for 10 mhz system clock
-void setup_system_clock() {
-  // make sure OSCCFG.FREQSEL fuse is 0x02 for 20 MHz base clock
-
-  // configure system clock source
-  _PROTECTED_WRITE(CLKCTRL.MCLKCTRLA, CLKCTRL_CLKSEL_OSC20M_gc);
-
-  // enable system clock prescaler with 2X division for 10 mhz
-  _PROTECTED_WRITE(CLKCTRL.MCLKCTRLB, CLKCTRL_PDIV_2X_gc | CLKCTRL_PEN_bm);
-
-  // lock the main clock registers from further modification
-  _PROTECTED_WRITE(CLKCTRL.MCLKLOCK, CLKCTRL_LOCKEN_bm);
-
-}
+/**
+ * The external crystal takes some hundred milliseconds to start up,
+ * after power-on and after power-down, where nothing requests it. No
+ * one waits for it: the rtc counts from the internal 32 kHz oscillator
+ * in the meantime and rtc_crystal() moves it over once the crystal is
+ * stable. The counter keeps its value across the switch, so deadlines
+ * and countdowns only run up to 10 % off until then.
+ **/
 
-// use external 32.768 khz crystal for rtc
+// start the external 32.768 khz crystal, without waiting for it
 void setup_crystal() {
   //? Per datasheet: "To change settings in a safe way: write a '0' to
   //? the ENABLE bit and wait until XOSC32KS is '0' before re-enabling
@@ -30,84 +27,123 @@ void setup_crystal() {
   _PROTECTED_WRITE(CLKCTRL.XOSC32KCTRLA, (0 << CLKCTRL_ENABLE_bp));
   while (CLKCTRL.MCLKSTATUS & CLKCTRL_XOSC32KS_bm);
 
-  // enable oscillator on external crystal
-  _PROTECTED_WRITE(CLKCTRL.XOSC32KCTRLA, (0 << CLKCTRL_SEL_bp) | CLKCTRL_ENABLE_bm);
-
-  // select crystal as rtc source
-  RTC.CLKSEL = RTC_CLKSEL_TOSC32K_gc;
-
-}
-
-// enable the periodic interrupt timer with given period
-void setup_pit_ticks(RTC_PERIOD_t tick_period) {
-
-  // enable the periodic interrupt with with given cycle length
-  RTC.PITCTRLA = tick_period | RTC_PITEN_bm;
-  while (RTC.PITSTATUS);
-  RTC.PITINTCTRL = RTC_PI_bm;
+  // enable oscillator on external crystal, and keep it running while
+  // nothing requests it yet, so it can start up
+  _PROTECTED_WRITE(CLKCTRL.XOSC32KCTRLA, (0 << CLKCTRL_SEL_bp) | CLKCTRL_RUNSTDBY_bm | CLKCTRL_ENABLE_bm);
 
 }
 
-// enable the rtc timer interrupt to count down seconds
-void setup_rtc_seconds() {
+// let the rtc count freely at 1024 Hz, all timing uses compare matches
+void setup_rtc() {
 
   // wait for sync first
   while (RTC.STATUS);
 
-  // run in standby, don't use prescaler
-  RTC.CTRLA = RTC_RUNSTDBY_bm | RTC_PRESCALER_DIV1_gc | RTC_RTCEN_bm;
+  // start on the internal oscillator, see rtc_crystal()
+  RTC.CLKSEL = RTC_CLKSEL_INT32K_gc;
 
-  // configure for an overflow interrupt every second
+  // run in standby, divide the clock down to 1024 Hz
+  RTC.CTRLA = RTC_RUNSTDBY_bm | RTC_PRESCALER_DIV32_gc | RTC_RTCEN_bm;
+
+  // use the full 16 bit range, wrapping every 64 seconds
   ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
     RTC.CNT = 0;
-    RTC.PER = 32768;
+    RTC.PER = 0xFFFF;
   }
 
 }
 
+// change the rtc clock, which needs the rtc disabled for a moment; the
+// pit stops and resumes with it, see below, and the counter keeps its
+// value, at most a tick is lost
+static void rtc_clock(uint8_t clksel) {
+  while (RTC.STATUS & RTC_CTRLABUSY_bm);
+  RTC.CTRLA = 0;
+  while (RTC.STATUS & RTC_CTRLABUSY_bm);
+  RTC.CLKSEL = clksel;
+  RTC.CTRLA = RTC_RUNSTDBY_bm | RTC_PRESCALER_DIV32_gc | RTC_RTCEN_bm;
+}
+
+// switch the rtc to the crystal once it is stable; returns false while
+// it is still starting up
+bool rtc_crystal() {
+  if (RTC.CLKSEL == RTC_CLKSEL_TOSC32K_gc) return true;
+  if (!(CLKCTRL.MCLKSTATUS & CLKCTRL_XOSC32KS_bm)) return false;
+  rtc_clock(RTC_CLKSEL_TOSC32K_gc);
+  // from now on, the crystal runs only as long as the rtc or pit need it
+  _PROTECTED_WRITE(CLKCTRL.XOSC32KCTRLA, (0 << CLKCTRL_SEL_bp) | CLKCTRL_ENABLE_bm);
+  return true;
+}
+
+// back to the internal oscillator before the crystal stops in power-down
+void rtc_internal() {
+  if (RTC.CLKSEL == RTC_CLKSEL_INT32K_gc) return;
+  rtc_clock(RTC_CLKSEL_INT32K_gc);
+}
+
 /**
- * Due to the following errata, the RTC should not be disabled via RTC.CTRLA!
- * It will also stop the PIT. Therefore the best we could do is disable the
- * RTC overflow interrupt and save the counter value to restore it later.
+ * Due to the following errata, the RTC should never be disabled via
+ * RTC.CTRLA! It would also stop the PIT, which provides the events for
+ * the LED alarm. The counter simply keeps running and only the compare
+ * interrupt is switched on and off.
  * 
  *  2.6.2 Disabling the RTC Stops the PIT
  *    Writing RTC.CTRLA.RTCEN to ‘0’ will stop the PIT.
  *    Writing RTC.PITCTRLA.PITEN to ‘0’ will stop the RTC.
  *  Work Around
  *    Do not disable the RTC or the PIT if any of the modules are used.
+ * 
+ * The PIT is only stopped for power-down, where the RTC does not count
+ * anyway and the crystal should stop as well. run_pit() restarts both.
+ * rtc_clock() disables the RTC for a moment only, the PIT resumes with it.
  **/
 
-// start the rtc counter from given count and enable overflow interrupt
-void run_rtc(uint16_t cnt) {
-  while (RTC.STATUS & RTC_CNTBUSY_bm);
+// run the PIT for its events, without an interrupt
+void run_pit() {
+  if (RTC.PITCTRLA & RTC_PITEN_bm) return;
+  while (RTC.PITSTATUS);
+  RTC.PITCTRLA = RTC_PERIOD_CYC8192_gc | RTC_PITEN_bm;
+  // make sure the RTC runs again after halt_pit()
+  RTC.CTRLA = RTC_RUNSTDBY_bm | RTC_PRESCALER_DIV32_gc | RTC_RTCEN_bm;
+}
+
+// stop the PIT before power-down; returns whether it was running
+bool halt_pit() {
+  if (!(RTC.PITCTRLA & RTC_PITEN_bm)) return false;
+  while (RTC.PITSTATUS);
+  RTC.PITCTRLA = 0;
+  return true;
+}
+
+// free-running time in 1/1024 seconds, wraps every 64 seconds
+uint16_t rtc_time() {
+  uint16_t now;
   ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
-    RTC.CNT = cnt;
-    while (RTC.STATUS & RTC_CNTBUSY_bm);
-    RTC.INTCTRL = RTC_OVF_bm;
-    RTC.INTFLAGS = RTC_OVF_bm;
+    now = RTC.CNT;
   }
+  return now;
 }
 
-// disable the rtc overflow interrupt and return current count
-uint16_t halt_rtc() {
-  uint16_t cnt;
+// post event_deadline when rtc_time() reaches the given time
+void rtc_alarm(uint16_t at) {
+  while (RTC.STATUS & RTC_CMPBUSY_bm);
   ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
-    cnt = RTC.CNT;
-    RTC.INTCTRL = (0 << RTC_OVF_bp);
+    RTC.CMP = at;
+    RTC.INTFLAGS = RTC_CMP_bm;
+    RTC.INTCTRL = RTC_CMP_bm;
   }
-  return cnt;
 }
 
-// periodic interrupt stub that calls external tick()
-ISR(RTC_PIT_vect) {
-  tick();
-  // clear the interrupt flag
-  RTC.PITINTFLAGS = RTC_PI_bm;
+// cancel the deadline
+void rtc_alarm_off() {
+  RTC.INTCTRL = 0;
 }
 
-// rtc overflow stub that calls external second()
+// rtc compare stub, the deadlines are handled in the main loop
 ISR(RTC_CNT_vect) {
-  second();
+  profile_isr(profile_rtc);
+  trace(trace_isr, profile_rtc);
   // clear the interrupt flag
-  RTC.INTFLAGS = RTC_OVF_bm;
-}
\ No newline at end of file
+  RTC.INTFLAGS = RTC_CMP_bm;
+  events_post(event_deadline);
+}
@@ -1,26 +1,28 @@
-// Configure the ATtiny417 system clock and RTC
+// Configure the ATtiny417 crystal and RTC
 // Copyright (c) 2022 Anton Semjonov
 // Licensed under the MIT License
 
 #pragma once
 
 #include <stdint.h>
-#include <avr/io.h>
-#include <avr/interrupt.h>
-#include <util/atomic.h>
+#include <stdbool.h>
 
+#include "hal.h"
 
-#if (F_CPU != 10000000L)
-#error F_CPU should be defined as 10 MHz
-#endif
 
-void setup_system_clock();
 void setup_crystal();
-void setup_pit_ticks(RTC_PERIOD_t tick_period);
-void setup_rtc_seconds();
+void setup_rtc();
 
-void run_rtc(uint16_t cnt);
-uint16_t halt_rtc();
+// the rtc counts at 1024 Hz and wraps every 64 seconds
+#define RTC_HZ 1024
+#define RTC_MS(ms) ((uint16_t)((ms) * (uint32_t)RTC_HZ / 1000))
 
-extern void tick();
-extern void second();
+uint16_t rtc_time();
+void rtc_alarm(uint16_t at);
+void rtc_alarm_off();
+
+bool rtc_crystal();
+void rtc_internal();
+
+void run_pit();
+bool halt_pit();
@@ -23,23 +23,3 @@ void disable_unused_pins() {
   PORTC.PIN4CTRL = PORT_ISC_INPUT_DISABLE_gc;
   PORTC.PIN5CTRL = PORT_ISC_INPUT_DISABLE_gc;
 }
-
-// setup buttons with pin-change interrupts
-void setup_buttons() {
-  // set PB6, PB7 as inputs
-  PORTB.DIRCLR = PIN6_bm | PIN7_bm;
-  // enable pin interrupts on those pins, no inversion, no pullup
-  PORTB.PIN6CTRL = PORT_ISC_BOTHEDGES_gc; // add
-  PORTB.PIN7CTRL = PORT_ISC_BOTHEDGES_gc; // set
-}
-
-ISR(PORTB_PORT_vect) {
-  if (PORTB.INTFLAGS & PORT_INT6_bm) {
-    button_add();
-    PORTB.INTFLAGS |= PORT_INT6_bm;
-  }
-  if (PORTB.INTFLAGS & PORT_INT7_bm) {
-    button_set();
-    PORTB.INTFLAGS |= PORT_INT7_bm;
-  }
-}
\ No newline at end of file
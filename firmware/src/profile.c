@@ -0,0 +1,27 @@
+// Count wakeups and cycles per interrupt handler with -D PROFILE
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#include "profile.h"
+
+#if defined(PROFILE) && !defined(SIMULATOR)
+
+volatile uint16_t profile_wakeups[profile_sources];
+volatile uint32_t profile_cycles[profile_sources];
+volatile uint16_t profile_boot_cycles[boot_stages];
+volatile uint16_t profile_boot_ticks[boot_stages];
+
+// free-running 16 bit cycle counter on the peripheral clock
+void setup_profile() {
+  TCA0.SINGLE.PER = 0xFFFF;
+  TCA0.SINGLE.CTRLA = TCA_SINGLE_CLKSEL_DIV1_gc | TCA_SINGLE_ENABLE_bm;
+}
+
+// called through the cleanup attribute when the handler returns
+void profile_leave(profile_scope *scope) {
+  uint16_t cycles = TCA0.SINGLE.CNT - scope->start;
+  profile_wakeups[scope->source]++;
+  profile_cycles[scope->source] += cycles;
+}
+
+#endif
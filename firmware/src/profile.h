@@ -0,0 +1,83 @@
+// Count wakeups and cycles per interrupt handler with -D PROFILE
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#pragma once
+
+#include <stdint.h>
+
+#include "hal.h"
+
+/**
+ * With -D PROFILE on the target, TCA0 counts CLK_PER cycles and every
+ * handler that starts with profile_isr() adds its wakeup and its
+ * cycles to the counters below. Read them with a debugger or by
+ * dumping the RAM through UPDI. The counter only runs while the CPU
+ * is awake, which is exactly the time that is measured. The ISR
+ * prologue and the wakeup from standby are not included. The TWI host
+ * handler runs on level 1, so its cycles are also counted in a level 0
+ * handler it interrupted.
+ *
+ * The simulator keeps its own statistics and startup trace, so the
+ * macros are empty there and in regular builds.
+ **/
+
+typedef enum {
+  profile_rtc = 0,
+  profile_portb,
+  profile_twi,
+  profile_adc,
+  profile_bod,
+  profile_twis,
+  profile_sources,
+} profile_source;
+
+/**
+ * The startup is traced in stages, each with the cycle counter and the
+ * rtc counter at that point. The cycles are valid for the first 6.5 ms,
+ * which covers everything up to the first frame; the rtc ticks of 1/1024
+ * seconds are counted from setup_rtc(). The stages of the last wakeup
+ * from power-down overwrite boot_crystal only.
+ **/
+
+typedef enum {
+  boot_clock = 0, // system clock configured
+  boot_frame,     // greeting queued for the lcd
+  boot_shown,     // greeting sent
+  boot_ready,     // initial time shown, entering the main loop
+  boot_crystal,   // rtc switched over to the crystal
+  boot_stages,
+} boot_stage;
+
+#if defined(PROFILE) && !defined(SIMULATOR)
+
+extern volatile uint16_t profile_wakeups[profile_sources];
+extern volatile uint32_t profile_cycles[profile_sources];
+extern volatile uint16_t profile_boot_cycles[boot_stages];
+extern volatile uint16_t profile_boot_ticks[boot_stages];
+
+typedef struct {
+  uint16_t start;
+  profile_source source;
+} profile_scope;
+
+void setup_profile();
+void profile_leave(profile_scope *scope);
+
+// count this handler, the cycles are added whenever it returns
+#define profile_isr(src) \
+  profile_scope profile_scope_ __attribute__((cleanup(profile_leave))) = { TCA0.SINGLE.CNT, src }
+
+// note the time of a startup stage
+#define profile_stage(stage) do { \
+    profile_boot_cycles[stage] = TCA0.SINGLE.CNT; \
+    profile_boot_ticks[stage] = RTC.CNT; \
+  } while (0)
+
+#else
+
+#define setup_profile()
+#define profile_isr(src)
+#define profile_stage(stage)
+
+#endif
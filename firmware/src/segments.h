@@ -76,8 +76,7 @@
 #define CHAR_8 Aa|Ab|Ac|Ad|Ae|Af|Ag   // the number 8
 #define CHAR_9 Aa|Ab|Ac|Ad|Ag|Af      // the number 9
 
-uint8_t NUMBERS[10] = { CHAR_0, CHAR_1, CHAR_2, CHAR_3,
-  CHAR_4, CHAR_5, CHAR_6, CHAR_7, CHAR_8, CHAR_9 };
+// the digits are looked up with NUMBERS, see font.h
 
 // symbols
 #define CHAR_POINT    Ap        // a point '.' (bytes 1, 3, 4)
@@ -89,6 +88,7 @@ uint8_t NUMBERS[10] = { CHAR_0, CHAR_1, CHAR_2, CHAR_3,
 #define CHAR_EQUAL    Ad|Ag     // an equals sign '='
 #define CHAR_IDENT    Aa|Ad|Ag  // an identical sign '≡'
 #define CHAR_SPACE    0         // an empty space ' '
+#define CHAR_PRIME    Ab        // a prime ''' for minutes
 
 // alphabet
 #define CHAR_A  Aa|Ab|Ac|Ae|Af|Ag
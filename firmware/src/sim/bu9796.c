@@ -0,0 +1,147 @@
+// Rohm BU9796 lcd driver model for the host simulator
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+#include "../lcddriver.h"
+
+// segments.h defines its lookup table in the header, rename our copy
+#define NUMBERS sim_numbers
+#include "../segments.h"
+#undef NUMBERS
+
+
+// DDRAM with 20 4-bit addresses, two per byte
+static uint8_t ddram[10];
+static uint8_t address = 0;
+
+// next byte of the transaction is a command
+static bool command = true;
+
+// controller state
+static bool powered = false;
+static bool display_on = false;
+static uint8_t blink = LCD_BLKCTL_off;
+static uint8_t apctl = 0;
+static uint8_t disctl = 0;
+
+// datasheet defaults after a reset
+#define DISCTL_RESET (LCD_DISCTL_framerate_80Hz | LCD_DISCTL_waveform_lineinv | LCD_DISCTL_powersave_norm)
+
+// software or power-on reset
+static void reset() {
+  memset(ddram, 0, sizeof(ddram));
+  address = 0;
+  display_on = false;
+  blink = LCD_BLKCTL_off;
+  apctl = 0;
+  disctl = DISCTL_RESET;
+}
+
+void bu9796_power(bool on) {
+  if (on && !powered) reset();
+  powered = on;
+}
+
+// a start condition addressed to the controller
+void bu9796_start() {
+  command = true;
+}
+
+void bu9796_write(uint8_t byte) {
+
+  if (!powered) return;
+
+  // data is written to consecutive addresses
+  if (!command) {
+    ddram[(address / 2) % sizeof(ddram)] = byte;
+    address = (address + 2) % (2 * sizeof(ddram));
+    return;
+  }
+
+  // CMDBIT announces another command, otherwise data follows
+  command = byte & CMDBIT;
+  uint8_t c = byte & ~CMDBIT;
+
+  if ((c & 0xE0) == 0x00) {
+    address = c & LCD_ADSET_mask;
+  } else if ((c & 0xE0) == LCD_DISCTL_cmd) {
+    // display control only affects power consumption
+    disctl = c & 0x1F;
+  } else if ((c & 0xE0) == LCD_MODESET_cmd) {
+    display_on = c & (LCD_MODESET_ON);
+  } else if ((c & 0xF8) == LCD_ICSET_cmd) {
+    if (c & (LCD_ICSET_reset)) reset();
+  } else if ((c & 0xF8) == LCD_BLKCTL_cmd) {
+    blink = c & 0x03;
+  } else if ((c & 0xFC) == LCD_APCTL_cmd) {
+    apctl = c & 0x03;
+  }
+
+}
+
+/**
+ * Supply current in µA while powered. The typical 15 µA are for the
+ * reset defaults; the power save modes scale it by the factors given in
+ * the datasheet. The frame rate and waveform are not modelled, which
+ * underestimates the savings of the low profile.
+ **/
+#define UA_BU9796 15.0
+
+double bu9796_current() {
+  static const double psm[4] = { 0.5, 0.67, 1.0, 1.8 };
+  return UA_BU9796 * psm[disctl & 0x03];
+}
+
+void bu9796_stop() {
+  command = true;
+}
+
+uint8_t bu9796_blink() {
+  return blink;
+}
+
+// characters that can be told apart by their segments, digits first
+static const struct { uint8_t segments; char c; } glyphs[] = {
+  { CHAR_0, '0' }, { CHAR_1, '1' }, { CHAR_2, '2' }, { CHAR_3, '3' },
+  { CHAR_4, '4' }, { CHAR_5, '5' }, { CHAR_6, '6' }, { CHAR_7, '7' },
+  { CHAR_8, '8' }, { CHAR_9, '9' },
+  { CHAR_A, 'A' }, { CHAR_b, 'b' }, { CHAR_C, 'C' }, { CHAR_c, 'c' },
+  { CHAR_d, 'd' }, { CHAR_E, 'E' }, { CHAR_F, 'F' }, { CHAR_H, 'H' },
+  { CHAR_h, 'h' }, { CHAR_I, 'I' }, { CHAR_i, 'i' }, { CHAR_J, 'J' },
+  { CHAR_k, 'k' }, { CHAR_L, 'L' }, { CHAR_n, 'n' }, { CHAR_o, 'o' },
+  { CHAR_P, 'P' }, { CHAR_q, 'q' }, { CHAR_r, 'r' }, { CHAR_t, 't' },
+  { CHAR_U, 'U' }, { CHAR_u, 'u' }, { CHAR_y, 'y' },
+  { CHAR_MINUS, '-' }, { CHAR_UNDER, '_' }, { CHAR_EQUAL, '=' },
+  { CHAR_PRIME, '\'' }, { CHAR_SPACE, ' ' },
+};
+
+static char glyph(uint8_t segments) {
+  for (size_t i = 0; i < sizeof(glyphs) / sizeof(glyphs[0]); i++) {
+    if (glyphs[i].segments == (uint8_t)segments) return glyphs[i].c;
+  }
+  return '?';
+}
+
+// render the visible digits, e.g. "12:34" or "HELO"; the first DDRAM byte
+// is the rightmost digit and the point of the second digit is the colon
+const char *bu9796_text() {
+
+  static char text[16];
+  if (!powered) return "(no power)";
+  if (!display_on || (apctl & LCD_APCTL_APOFF_allOFF)) return "(off)";
+  if (apctl & LCD_APCTL_APON_allON) return "88:88";
+
+  char *p = text;
+  for (int8_t i = 3; i >= 0; i--) {
+    *p++ = glyph(ddram[i] & ~Ap);
+    if (i == 2) *p++ = (ddram[i] & Ap) ? ':' : ' ';
+    else if (ddram[i] & Ap) *p++ = '.';
+  }
+  *p = '\0';
+  return text;
+
+}
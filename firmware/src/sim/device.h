@@ -0,0 +1,511 @@
+// Register model of the ATtiny417 peripherals used by the firmware
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Peripheral registers are plain memory on the host. The simulator in
+ * sim.c applies their side effects between interrupt handlers and the
+ * main loop, so most registers are declared exactly like on the target.
+ * A few registers that trigger an action on every write are widened to
+ * 16 bit and preset with SIM_UNWRITTEN, to detect a write of any value:
+ * 
+ *   - TWI0.MADDR and TWI0.MDATA start a transfer
+ * 
+ * The EEPROM is mapped to the array sim_eeprom, like into the data
+ * space on the target. Writes go straight to the array, the commands in
+ * NVMCTRL.CTRLA are only counted, see sim.c.
+ * 
+ * The ports are accessed through sim_port(), which applies the pending
+ * strobe register writes (DIRSET, OUTSET, ...) before each access, so
+ * several writes in a row accumulate like on the target. Interrupt flags
+ * are cleared once their handler returns.
+ * 
+ * Only the registers and constants that the firmware uses are defined;
+ * the values match the ATtiny417 device header.
+ * 
+ **/
+
+typedef volatile uint8_t register8_t;
+typedef volatile uint16_t register16_t;
+
+// marks a write-triggered register as not written since the last step
+#define SIM_UNWRITTEN 0xFFFF
+
+
+// ---------- core functions ---------- //
+
+// interrupt handlers are plain functions, called by the simulator
+#define ISR(vector) void vector(void)
+
+// there's no concurrency on the host, interrupts only fire while sleeping
+#define sei()
+#define cli()
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define ATOMIC_BLOCK(type) for (uint8_t _atomic = 1; _atomic; _atomic = 0)
+
+// configuration change protection is not simulated
+#define _PROTECTED_WRITE(reg, value) ((reg) = (value))
+#define _PROTECTED_WRITE_SPM(reg, value) ((reg) = (value))
+
+// sleeping advances simulated time until the next interrupt
+void sim_sleep();
+#define sleep_cpu() sim_sleep()
+
+// interrupt vectors, weak so the firmware doesn't need to define all of them
+#define SIM_VECTOR(vector) void vector(void) __attribute__((weak))
+SIM_VECTOR(RTC_CNT_vect);
+SIM_VECTOR(RTC_PIT_vect);
+SIM_VECTOR(PORTA_PORT_vect);
+SIM_VECTOR(PORTB_PORT_vect);
+SIM_VECTOR(TWI0_TWIM_vect);
+SIM_VECTOR(TWI0_TWIS_vect);
+SIM_VECTOR(ADC0_RESRDY_vect);
+SIM_VECTOR(BOD_VLM_vect);
+
+// vector numbers as on the ATtiny417, for the priority level
+#define BOD_VLM_vect_num 2
+#define PORTB_PORT_vect_num 4
+#define RTC_CNT_vect_num 6
+#define RTC_PIT_vect_num 7
+#define ADC0_RESRDY_vect_num 17
+#define TWI0_TWIS_vect_num 19
+#define TWI0_TWIM_vect_num 20
+
+
+// ---------- CPUINT ---------- //
+
+typedef struct {
+  register8_t CTRLA, STATUS, LVL0PRI, LVL1VEC;
+} CPUINT_t;
+extern CPUINT_t CPUINT;
+
+#define CPUINT_LVL0RR_bm 0x01
+#define CPUINT_CVT_bm 0x20
+#define CPUINT_IVSEL_bm 0x40
+
+
+// ---------- GPIO ---------- //
+
+// general purpose i/o registers, plain bytes without a function
+extern register8_t GPIOR0, GPIOR1, GPIOR2, GPIOR3;
+
+
+// ---------- RSTCTRL ---------- //
+
+typedef struct {
+  register8_t RSTFR, SWRR;
+} RSTCTRL_t;
+extern RSTCTRL_t RSTCTRL;
+
+#define RSTCTRL_PORF_bm 0x01
+#define RSTCTRL_BORF_bm 0x02
+#define RSTCTRL_EXTRF_bm 0x04
+#define RSTCTRL_WDRF_bm 0x08
+#define RSTCTRL_SWRF_bm 0x10
+#define RSTCTRL_UPDIRF_bm 0x20
+
+// ---------- CLKCTRL ---------- //
+
+typedef struct {
+  register8_t MCLKCTRLA, MCLKCTRLB, MCLKLOCK, MCLKSTATUS;
+  register8_t OSC20MCTRLA, OSC20MCALIBA, OSC20MCALIBB;
+  register8_t OSC32KCTRLA, XOSC32KCTRLA;
+} CLKCTRL_t;
+extern CLKCTRL_t CLKCTRL;
+
+#define CLKCTRL_CLKSEL_gm 0x03
+#define CLKCTRL_CLKSEL_OSC20M_gc (0x00<<0)
+#define CLKCTRL_CLKSEL_OSCULP32K_gc (0x01<<0)
+#define CLKCTRL_CLKSEL_XOSC32K_gc (0x02<<0)
+#define CLKCTRL_CLKSEL_EXTCLK_gc (0x03<<0)
+#define CLKCTRL_PDIV_gm 0x1E
+#define CLKCTRL_PDIV_2X_gc (0x00<<1)
+#define CLKCTRL_PDIV_4X_gc (0x01<<1)
+#define CLKCTRL_PDIV_8X_gc (0x02<<1)
+#define CLKCTRL_PDIV_16X_gc (0x03<<1)
+#define CLKCTRL_PDIV_32X_gc (0x04<<1)
+#define CLKCTRL_PDIV_64X_gc (0x05<<1)
+#define CLKCTRL_PDIV_6X_gc (0x08<<1)
+#define CLKCTRL_PDIV_10X_gc (0x09<<1)
+#define CLKCTRL_PDIV_12X_gc (0x0A<<1)
+#define CLKCTRL_PDIV_24X_gc (0x0B<<1)
+#define CLKCTRL_PDIV_48X_gc (0x0C<<1)
+#define CLKCTRL_PEN_bm 0x01
+#define CLKCTRL_LOCKEN_bm 0x01
+#define CLKCTRL_EXTS_bm 0x80
+#define CLKCTRL_XOSC32KS_bm 0x40
+#define CLKCTRL_OSC32KS_bm 0x20
+#define CLKCTRL_OSC20MS_bm 0x10
+#define CLKCTRL_SOSC_bm 0x01
+#define CLKCTRL_ENABLE_bm 0x01
+#define CLKCTRL_ENABLE_bp 0
+#define CLKCTRL_RUNSTDBY_bm 0x02
+#define CLKCTRL_SEL_bm 0x04
+#define CLKCTRL_SEL_bp 2
+#define CLKCTRL_CSUT_gm 0x30
+
+
+// ---------- SLPCTRL ---------- //
+
+typedef struct {
+  register8_t CTRLA;
+} SLPCTRL_t;
+extern SLPCTRL_t SLPCTRL;
+
+#define SLPCTRL_SMODE_gm 0x06
+#define SLPCTRL_SMODE_IDLE_gc (0x00<<1)
+#define SLPCTRL_SMODE_STDBY_gc (0x01<<1)
+#define SLPCTRL_SMODE_PDOWN_gc (0x02<<1)
+#define SLPCTRL_SEN_bm 0x01
+
+
+// ---------- PORT ---------- //
+
+typedef struct {
+  register8_t DIR, DIRSET, DIRCLR, DIRTGL;
+  register8_t OUT, OUTSET, OUTCLR, OUTTGL;
+  register8_t IN, INTFLAGS, PORTCTRL;
+  register8_t PIN0CTRL, PIN1CTRL, PIN2CTRL, PIN3CTRL;
+  register8_t PIN4CTRL, PIN5CTRL, PIN6CTRL, PIN7CTRL;
+} PORT_t;
+PORT_t *sim_port(uint8_t index);
+#define PORTA (*sim_port(0))
+#define PORTB (*sim_port(1))
+#define PORTC (*sim_port(2))
+
+#define PIN0_bm 0x01
+#define PIN1_bm 0x02
+#define PIN2_bm 0x04
+#define PIN3_bm 0x08
+#define PIN4_bm 0x10
+#define PIN5_bm 0x20
+#define PIN6_bm 0x40
+#define PIN7_bm 0x80
+#define PORT_INT0_bm 0x01
+#define PORT_INT1_bm 0x02
+#define PORT_INT2_bm 0x04
+#define PORT_INT3_bm 0x08
+#define PORT_INT4_bm 0x10
+#define PORT_INT5_bm 0x20
+#define PORT_INT6_bm 0x40
+#define PORT_INT7_bm 0x80
+#define PORT_INVEN_bm 0x80
+#define PORT_PULLUPEN_bm 0x08
+#define PORT_ISC_gm 0x07
+#define PORT_ISC_INTDISABLE_gc (0x00<<0)
+#define PORT_ISC_BOTHEDGES_gc (0x01<<0)
+#define PORT_ISC_RISING_gc (0x02<<0)
+#define PORT_ISC_FALLING_gc (0x03<<0)
+#define PORT_ISC_INPUT_DISABLE_gc (0x04<<0)
+#define PORT_ISC_LEVEL_gc (0x05<<0)
+
+
+// ---------- RTC ---------- //
+
+typedef struct {
+  register8_t CTRLA, STATUS, INTCTRL, INTFLAGS, TEMP, DBGCTRL, CLKSEL;
+  register16_t CNT, PER, CMP;
+  register8_t PITCTRLA, PITSTATUS, PITINTCTRL, PITINTFLAGS, PITDBGCTRL;
+} RTC_t;
+extern RTC_t RTC;
+
+#define RTC_RUNSTDBY_bm 0x80
+#define RTC_PRESCALER_gm 0x78
+#define RTC_PRESCALER_gp 3
+#define RTC_PRESCALER_DIV1_gc (0x00<<3)
+#define RTC_PRESCALER_DIV2_gc (0x01<<3)
+#define RTC_PRESCALER_DIV4_gc (0x02<<3)
+#define RTC_PRESCALER_DIV8_gc (0x03<<3)
+#define RTC_PRESCALER_DIV16_gc (0x04<<3)
+#define RTC_PRESCALER_DIV32_gc (0x05<<3)
+#define RTC_PRESCALER_DIV64_gc (0x06<<3)
+#define RTC_PRESCALER_DIV128_gc (0x07<<3)
+#define RTC_PRESCALER_DIV256_gc (0x08<<3)
+#define RTC_PRESCALER_DIV512_gc (0x09<<3)
+#define RTC_PRESCALER_DIV1024_gc (0x0A<<3)
+#define RTC_RTCEN_bm 0x01
+#define RTC_CMPBUSY_bm 0x08
+#define RTC_PERBUSY_bm 0x04
+#define RTC_CNTBUSY_bm 0x02
+#define RTC_CTRLABUSY_bm 0x01
+#define RTC_CMP_bm 0x02
+#define RTC_CMP_bp 1
+#define RTC_OVF_bm 0x01
+#define RTC_OVF_bp 0
+#define RTC_CLKSEL_gm 0x03
+#define RTC_CLKSEL_INT32K_gc (0x00<<0)
+#define RTC_CLKSEL_INT1K_gc (0x01<<0)
+#define RTC_CLKSEL_TOSC32K_gc (0x02<<0)
+#define RTC_CLKSEL_EXTCLK_gc (0x03<<0)
+#define RTC_PERIOD_gm 0x78
+#define RTC_PERIOD_gp 3
+typedef enum {
+  RTC_PERIOD_OFF_gc = (0x00<<3),
+  RTC_PERIOD_CYC4_gc = (0x01<<3),
+  RTC_PERIOD_CYC8_gc = (0x02<<3),
+  RTC_PERIOD_CYC16_gc = (0x03<<3),
+  RTC_PERIOD_CYC32_gc = (0x04<<3),
+  RTC_PERIOD_CYC64_gc = (0x05<<3),
+  RTC_PERIOD_CYC128_gc = (0x06<<3),
+  RTC_PERIOD_CYC256_gc = (0x07<<3),
+  RTC_PERIOD_CYC512_gc = (0x08<<3),
+  RTC_PERIOD_CYC1024_gc = (0x09<<3),
+  RTC_PERIOD_CYC2048_gc = (0x0A<<3),
+  RTC_PERIOD_CYC4096_gc = (0x0B<<3),
+  RTC_PERIOD_CYC8192_gc = (0x0C<<3),
+  RTC_PERIOD_CYC16384_gc = (0x0D<<3),
+  RTC_PERIOD_CYC32768_gc = (0x0E<<3),
+} RTC_PERIOD_t;
+#define RTC_PITEN_bm 0x01
+#define RTC_CTRLBUSY_bm 0x01
+#define RTC_PI_bm 0x01
+#define RTC_PI_bp 0
+
+
+// ---------- TCB and EVSYS ---------- //
+
+typedef struct {
+  register8_t CTRLA, CTRLB, reserved[2], EVCTRL, INTCTRL, INTFLAGS, STATUS, DBGCTRL, TEMP;
+  register16_t CNT, CCMP;
+} TCB_t;
+extern TCB_t TCB0;
+
+#define TCB_RUNSTDBY_bm 0x40
+#define TCB_SYNCUPD_bm 0x10
+#define TCB_CLKSEL_gm 0x06
+#define TCB_CLKSEL_CLKDIV1_gc (0x00<<1)
+#define TCB_CLKSEL_CLKDIV2_gc (0x01<<1)
+#define TCB_CLKSEL_CLKTCA_gc (0x02<<1)
+#define TCB_ENABLE_bm 0x01
+#define TCB_ASYNC_bm 0x40
+#define TCB_CCMPINIT_bm 0x20
+#define TCB_CCMPEN_bm 0x10
+#define TCB_CNTMODE_gm 0x07
+#define TCB_CNTMODE_INT_gc (0x00<<0)
+#define TCB_CNTMODE_TIMEOUT_gc (0x01<<0)
+#define TCB_CNTMODE_CAPT_gc (0x02<<0)
+#define TCB_CNTMODE_FRQ_gc (0x03<<0)
+#define TCB_CNTMODE_PW_gc (0x04<<0)
+#define TCB_CNTMODE_FRQPW_gc (0x05<<0)
+#define TCB_CNTMODE_SINGLE_gc (0x06<<0)
+#define TCB_CNTMODE_PWM8_gc (0x07<<0)
+#define TCB_FILTER_bm 0x40
+#define TCB_EDGE_bm 0x10
+#define TCB_CAPTEI_bm 0x01
+
+// only the channel and the user of the led alarm
+typedef struct {
+  register8_t ASYNCSTROBE, SYNCSTROBE;
+  register8_t ASYNCCH0, ASYNCCH1, ASYNCCH2, ASYNCCH3;
+  register8_t ASYNCUSER0;
+} EVSYS_t;
+extern EVSYS_t EVSYS;
+
+#define EVSYS_ASYNCCH3_OFF_gc (0x00<<0)
+#define EVSYS_ASYNCCH3_RTC_OVF_gc (0x08<<0)
+#define EVSYS_ASYNCCH3_RTC_CMP_gc (0x09<<0)
+#define EVSYS_ASYNCCH3_PIT_DIV8192_gc (0x0A<<0)
+#define EVSYS_ASYNCCH3_PIT_DIV4096_gc (0x0B<<0)
+#define EVSYS_ASYNCCH3_PIT_DIV2048_gc (0x0C<<0)
+#define EVSYS_ASYNCUSER0_OFF_gc (0x00<<0)
+#define EVSYS_ASYNCUSER0_ASYNCCH3_gc (0x06<<0)
+
+
+// ---------- VREF and DAC ---------- //
+
+typedef struct {
+  register8_t CTRLA, CTRLB;
+} VREF_t;
+extern VREF_t VREF;
+
+#define VREF_DAC0REFSEL_gm 0x07
+#define VREF_DAC0REFSEL_0V55_gc (0x00<<0)
+#define VREF_DAC0REFSEL_1V1_gc (0x01<<0)
+#define VREF_DAC0REFSEL_2V5_gc (0x02<<0)
+#define VREF_DAC0REFSEL_4V34_gc (0x03<<0)
+#define VREF_DAC0REFSEL_1V5_gc (0x04<<0)
+#define VREF_ADC0REFSEL_gm 0x70
+#define VREF_ADC0REFSEL_0V55_gc (0x00<<4)
+#define VREF_ADC0REFSEL_1V1_gc (0x01<<4)
+#define VREF_ADC0REFSEL_2V5_gc (0x02<<4)
+#define VREF_ADC0REFSEL_4V34_gc (0x03<<4)
+#define VREF_ADC0REFSEL_1V5_gc (0x04<<4)
+
+typedef struct {
+  register8_t CTRLA, DATA;
+} DAC_t;
+extern DAC_t DAC0;
+
+#define DAC_RUNSTDBY_bm 0x80
+#define DAC_OUTEN_bm 0x40
+#define DAC_ENABLE_bm 0x01
+
+
+// ---------- ADC ---------- //
+
+typedef struct {
+  register8_t CTRLA, CTRLB, CTRLC, CTRLD, CTRLE, SAMPCTRL, MUXPOS;
+  register8_t COMMAND, EVCTRL, INTCTRL, INTFLAGS, DBGCTRL, TEMP;
+  register16_t RES, WINLT, WINHT;
+  register8_t CALIB;
+} ADC_t;
+extern ADC_t ADC0;
+
+#define ADC_RUNSTBY_bm 0x80
+#define ADC_RESSEL_10BIT_gc (0x00<<2)
+#define ADC_RESSEL_8BIT_gc (0x01<<2)
+#define ADC_FREERUN_bm 0x02
+#define ADC_ENABLE_bm 0x01
+#define ADC_SAMPNUM_gm 0x07
+#define ADC_SAMPNUM_ACC1_gc (0x00<<0)
+#define ADC_SAMPNUM_ACC2_gc (0x01<<0)
+#define ADC_SAMPNUM_ACC4_gc (0x02<<0)
+#define ADC_SAMPNUM_ACC8_gc (0x03<<0)
+#define ADC_SAMPCAP_bm 0x40
+#define ADC_REFSEL_gm 0x30
+#define ADC_REFSEL_INTREF_gc (0x00<<4)
+#define ADC_REFSEL_VDDREF_gc (0x01<<4)
+#define ADC_PRESC_gm 0x07
+#define ADC_PRESC_DIV2_gc (0x00<<0)
+#define ADC_PRESC_DIV4_gc (0x01<<0)
+#define ADC_PRESC_DIV8_gc (0x02<<0)
+#define ADC_PRESC_DIV16_gc (0x03<<0)
+#define ADC_PRESC_DIV32_gc (0x04<<0)
+#define ADC_PRESC_DIV64_gc (0x05<<0)
+#define ADC_PRESC_DIV128_gc (0x06<<0)
+#define ADC_PRESC_DIV256_gc (0x07<<0)
+#define ADC_INITDLY_gm 0xE0
+#define ADC_INITDLY_DLY0_gc (0x00<<5)
+#define ADC_INITDLY_DLY16_gc (0x01<<5)
+#define ADC_INITDLY_DLY32_gc (0x02<<5)
+#define ADC_INITDLY_DLY64_gc (0x03<<5)
+#define ADC_MUXPOS_INTREF_gc (0x1D<<0)
+#define ADC_STCONV_bm 0x01
+#define ADC_RESRDY_bm 0x01
+
+
+// ---------- TWI ---------- //
+
+typedef struct {
+  register8_t CTRLA, DUALCTRL, DBGCTRL;
+  register8_t MCTRLA, MCTRLB, MSTATUS, MBAUD;
+  register16_t MADDR, MDATA; // widened, see above
+  register8_t SCTRLA, SCTRLB, SSTATUS, SADDR, SDATA, SADDRMASK;
+} TWI_t;
+extern TWI_t TWI0;
+
+#define TWI_SDASETUP_bm 0x10
+#define TWI_SDAHOLD_gm 0x0C
+#define TWI_FMPEN_bm 0x02
+#define TWI_RIEN_bm 0x80
+#define TWI_WIEN_bm 0x40
+#define TWI_QCEN_bm 0x10
+#define TWI_TIMEOUT_gm 0x0C
+#define TWI_TIMEOUT_DISABLED_gc (0x00<<2)
+#define TWI_TIMEOUT_50US_gc (0x01<<2)
+#define TWI_TIMEOUT_100US_gc (0x02<<2)
+#define TWI_TIMEOUT_200US_gc (0x03<<2)
+#define TWI_SMEN_bm 0x02
+#define TWI_ENABLE_bm 0x01
+#define TWI_FLUSH_bm 0x08
+#define TWI_ACKACT_bm 0x04
+#define TWI_ACKACT_ACK_gc (0x00<<2)
+#define TWI_ACKACT_NACK_gc (0x01<<2)
+#define TWI_MCMD_gm 0x03
+#define TWI_MCMD_NOACT_gc (0x00<<0)
+#define TWI_MCMD_REPSTART_gc (0x01<<0)
+#define TWI_MCMD_RECVTRANS_gc (0x02<<0)
+#define TWI_MCMD_STOP_gc (0x03<<0)
+#define TWI_RIF_bm 0x80
+#define TWI_WIF_bm 0x40
+#define TWI_CLKHOLD_bm 0x20
+#define TWI_RXACK_bm 0x10
+#define TWI_ARBLOST_bm 0x08
+#define TWI_BUSERR_bm 0x04
+#define TWI_BUSSTATE_gm 0x03
+#define TWI_BUSSTATE_UNKNOWN_gc (0x00<<0)
+#define TWI_BUSSTATE_IDLE_gc (0x01<<0)
+#define TWI_BUSSTATE_OWNER_gc (0x02<<0)
+#define TWI_BUSSTATE_BUSY_gc (0x03<<0)
+#define TWI_DIEN_bm 0x80
+#define TWI_APIEN_bm 0x40
+#define TWI_PIEN_bm 0x20
+#define TWI_PMEN_bm 0x04
+#define TWI_SCMD_gm 0x03
+#define TWI_SCMD_NOACT_gc (0x00<<0)
+#define TWI_SCMD_COMPTRANS_gc (0x02<<0)
+#define TWI_SCMD_RESPONSE_gc (0x03<<0)
+#define TWI_DIF_bm 0x80
+#define TWI_APIF_bm 0x40
+#define TWI_COLL_bm 0x08
+#define TWI_DIR_bm 0x02
+#define TWI_AP_bm 0x01
+
+
+// ---------- BOD ---------- //
+
+typedef struct {
+  register8_t CTRLA, CTRLB, reserved[6];
+  register8_t VLMCTRLA, INTCTRL, INTFLAGS, STATUS;
+} BOD_t;
+extern BOD_t BOD;
+
+#define BOD_SLEEP_gm 0x03
+#define BOD_SLEEP_DIS_gc (0x00<<0)
+#define BOD_SLEEP_ENABLED_gc (0x01<<0)
+#define BOD_SLEEP_SAMPLED_gc (0x02<<0)
+#define BOD_ACTIVE_gm 0x0C
+#define BOD_ACTIVE_DIS_gc (0x00<<2)
+#define BOD_ACTIVE_ENABLED_gc (0x01<<2)
+#define BOD_ACTIVE_SAMPLED_gc (0x02<<2)
+#define BOD_ACTIVE_ENWAKE_gc (0x03<<2)
+#define BOD_SAMPFREQ_bm 0x10
+#define BOD_SAMPFREQ_1KHZ_gc (0x00<<4)
+#define BOD_SAMPFREQ_125HZ_gc (0x01<<4)
+#define BOD_LVL_gm 0x07
+#define BOD_LVL_BODLEVEL0_gc (0x00<<0)
+#define BOD_LVL_BODLEVEL2_gc (0x02<<0)
+#define BOD_LVL_BODLEVEL7_gc (0x07<<0)
+#define BOD_VLMLVL_gm 0x03
+#define BOD_VLMLVL_5ABOVE_gc (0x00<<0)
+#define BOD_VLMLVL_15ABOVE_gc (0x01<<0)
+#define BOD_VLMLVL_25ABOVE_gc (0x02<<0)
+#define BOD_VLMCFG_gm 0x06
+#define BOD_VLMCFG_BELOW_gc (0x00<<1)
+#define BOD_VLMCFG_ABOVE_gc (0x01<<1)
+#define BOD_VLMCFG_CROSS_gc (0x02<<1)
+#define BOD_VLMIE_bm 0x01
+#define BOD_VLMIF_bm 0x01
+#define BOD_VLMS_bm 0x01
+
+
+// ---------- NVMCTRL and EEPROM ---------- //
+
+typedef struct {
+  register8_t CTRLA, CTRLB, STATUS, INTCTRL, INTFLAGS, reserved;
+  register16_t DATA, ADDR;
+} NVMCTRL_t;
+extern NVMCTRL_t NVMCTRL;
+
+#define NVMCTRL_CMD_gm 0x07
+#define NVMCTRL_CMD_NONE_gc (0x00<<0)
+#define NVMCTRL_CMD_PAGEWRITE_gc (0x01<<0)
+#define NVMCTRL_CMD_PAGEERASE_gc (0x02<<0)
+#define NVMCTRL_CMD_PAGEERASEWRITE_gc (0x03<<0)
+#define NVMCTRL_CMD_PAGEBUFCLR_gc (0x04<<0)
+#define NVMCTRL_CMD_CHIPERASE_gc (0x05<<0)
+#define NVMCTRL_CMD_EEERASE_gc (0x06<<0)
+#define NVMCTRL_CMD_FUSEWRITE_gc (0x07<<0)
+#define NVMCTRL_WRERROR_bm 0x04
+#define NVMCTRL_EEBUSY_bm 0x02
+#define NVMCTRL_FBUSY_bm 0x01
+
+#define EEPROM_SIZE 128
+#define EEPROM_PAGE_SIZE 32
+extern uint8_t sim_eeprom[EEPROM_SIZE];
+#define EEPROM_START ((uintptr_t)sim_eeprom)
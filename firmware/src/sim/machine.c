@@ -0,0 +1,167 @@
+// Check of the steep state machine for the host simulator
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#include <string.h>
+
+#include "sim.h"
+#include "../timers.h"
+
+/**
+ * Every input in every state of every steep, against a table written
+ * down separately from the one in teatime.c. The states, inputs and
+ * actions are numbered as there. Besides the next state and the actions
+ * of the entry, the effects are checked that the simulator can see: the
+ * countdown, the led and the shown steep. Each steep starts with 01:00
+ * and a preset of 03:00, or at zero when empty or finished.
+ *
+ * The auto-off is checked from the behaviour alone, not from the table:
+ * any input that is taken and leaves all steeps in idle is activity and
+ * must restart the deadline, or the lcd could go off in the middle of
+ * it. The other steeps are in idle during each check.
+ **/
+
+enum { idle, running, paused, finished, empty, states };
+
+enum {
+  set, set_up, add, add_up, hold, clear, zero, start, pause, restart, inputs,
+};
+
+static const char *state_names[] = {
+  "idle", "running", "paused", "finished", "empty",
+};
+static const char *input_names[] = {
+  "set", "set_up", "add", "add_up", "hold", "clear", "zero", "start", "pause", "restart",
+};
+
+#define PAUSE    0x001
+#define RESUME   0x002
+#define ADD_10S  0x004
+#define ADD_1MIN 0x008
+#define PRESET   0x010
+#define ZERO     0x020
+#define BREW     0x040
+#define TORCH    0x080
+#define DARK     0x100
+#define ALARM    0x200
+#define SHOW     0x400
+#define REMEMBER 0x800
+
+typedef struct {
+  uint16_t actions;
+  uint8_t next;
+} expected;
+
+static const expected table[states][inputs] = {
+  [empty] = {
+    [set]     = { TORCH | REMEMBER, idle },
+    [set_up]  = { DARK | REMEMBER, idle },
+    [add]     = { ADD_10S | REMEMBER, idle },
+    [add_up]  = { REMEMBER, idle },
+    [hold]    = { ADD_1MIN | REMEMBER, idle },
+    [clear]   = { ZERO | ALARM | REMEMBER, idle },
+    [zero]    = { 0, idle },
+    [start]   = { REMEMBER, idle },
+    [pause]   = { REMEMBER, idle },
+    [restart] = { PRESET | ALARM | REMEMBER, idle },
+  },
+  [idle] = {
+    [set]     = { BREW | REMEMBER, running },
+    [set_up]  = { DARK | REMEMBER, idle },
+    [add]     = { ADD_10S | REMEMBER, idle },
+    [add_up]  = { REMEMBER, idle },
+    [hold]    = { ADD_1MIN | REMEMBER, idle },
+    [clear]   = { ZERO | ALARM | REMEMBER, idle },
+    [zero]    = { 0, idle },
+    [start]   = { BREW | REMEMBER, running },
+    [pause]   = { REMEMBER, idle },
+    [restart] = { PRESET | ALARM | REMEMBER, idle },
+  },
+  [running] = {
+    [set]     = { PAUSE | REMEMBER, paused },
+    [set_up]  = { REMEMBER, running },
+    [add]     = { ADD_10S | REMEMBER, running },
+    [add_up]  = { REMEMBER, running },
+    [hold]    = { ADD_1MIN | REMEMBER, running },
+    [clear]   = { ZERO | ALARM | REMEMBER, idle },
+    [zero]    = { ALARM | SHOW | REMEMBER, finished },
+    [start]   = { REMEMBER, running },
+    [pause]   = { PAUSE | REMEMBER, paused },
+    [restart] = { PRESET | ALARM | REMEMBER, idle },
+  },
+  [paused] = {
+    [set]     = { RESUME | REMEMBER, running },
+    [set_up]  = { REMEMBER, paused },
+    [add]     = { ADD_10S | REMEMBER, paused },
+    [add_up]  = { REMEMBER, paused },
+    [hold]    = { ADD_1MIN | REMEMBER, paused },
+    [clear]   = { ZERO | ALARM | REMEMBER, idle },
+    [zero]    = { 0, paused },
+    [start]   = { RESUME | REMEMBER, running },
+    [pause]   = { REMEMBER, paused },
+    [restart] = { PRESET | ALARM | REMEMBER, idle },
+  },
+  [finished] = {
+    [set]     = { PRESET | ALARM | REMEMBER, idle },
+    [set_up]  = { REMEMBER, finished },
+    [add]     = { REMEMBER, finished },
+    [add_up]  = { REMEMBER, finished },
+    [hold]    = { 0, finished },
+    [clear]   = { ZERO | ALARM | REMEMBER, idle },
+    [zero]    = { 0, finished },
+    [start]   = { REMEMBER, finished },
+    [pause]   = { REMEMBER, finished },
+    [restart] = { PRESET | ALARM | REMEMBER, idle },
+  },
+};
+
+// the countdown after the actions, in bcd as in countdown.h
+static uint32_t countdown(uint8_t state, uint16_t actions) {
+  uint32_t t = (state == empty || state == finished) ? 0x00000 : 0x00100;
+  if (actions & ADD_10S) t += 0x10;
+  if (actions & ADD_1MIN) t += 0x100;
+  if (actions & PRESET) t = 0x00300;
+  if (actions & ZERO) t = 0x00000;
+  return t;
+}
+
+// the led after the actions, the alarm pulses with a good battery
+static const char *led(uint8_t state, const expected *e) {
+  const char *on = state == finished ? "pulsing" : "off";
+  if (e->actions & TORCH) on = strcmp(on, "off") == 0 ? "on" : "off";
+  if (e->actions & DARK && e->next != finished) on = "off";
+  if (e->actions & ALARM) on = e->next == finished ? "pulsing" : "off";
+  return on;
+}
+
+static int compare(uint8_t index, uint8_t state, uint8_t input) {
+  const expected *e = &table[state][input];
+  sim_transition r;
+  sim_steep_input(index, state, input, &r);
+  bool taken = e->actions != 0 || e->next != (state == empty ? idle : state);
+  uint8_t shown = (e->actions & SHOW) ? index : 0;
+  bool awake = r.taken && r.next == idle;
+  if (r.taken == taken && r.next == e->next && r.actions == e->actions &&
+      r.countdown == countdown(state, e->actions) && r.shown == shown &&
+      strcmp(r.led, led(state, e)) == 0 && r.awake == awake) return 0;
+  sim_log("FAIL steep %d %s on %s: expected %s %03x %05x led %s shown %d%s%s, "
+    "got %s %03x %05x led %s shown %d%s%s", index, input_names[input], state_names[state],
+    state_names[e->next], e->actions, countdown(state, e->actions), led(state, e), shown,
+    taken ? "" : " refused", awake ? " awake" : "", state_names[r.next % states], r.actions,
+    r.countdown, r.led, r.shown, r.taken ? "" : " refused", r.awake ? " awake" : "");
+  return 1;
+}
+
+// every input in every state on every steep, returns the failures
+int machine_check() {
+  int failures = 0;
+  for (uint8_t index = 0; index < TIMER_STEEPS; index++) {
+    for (uint8_t state = 0; state < states; state++) {
+      for (uint8_t input = 0; input < inputs; input++) {
+        failures += compare(index, state, input);
+      }
+    }
+  }
+  sim_log("machine: %d transitions, %d failed", TIMER_STEEPS * states * inputs, failures);
+  return failures;
+}
@@ -0,0 +1,311 @@
+// Scenario scripts for the host simulator
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+/**
+ * Scenarios are read from stdin, one command per line. Times are given
+ * with a unit (ms, s, m, h) and default to milliseconds:
+ * 
+ *   press add|set         press and hold a button
+ *   release add|set       release a button
+ *   tap add|set           short press of 100 ms and a pause of 100 ms
+ *   hold add|set <time>   long press of the given duration
+ *   bounce <n>            let the contacts bounce n times on every
+ *                         following press and release, 0.3 ms apart
+ *   wait <time>           let time pass
+ *   expect lcd "12:34"    compare the rendered display
+ *   expect blink <rate>   compare the blink rate: off, 0.5Hz, 1Hz, 2Hz
+ *   expect led <state>    compare the led state: on, off, pulsing
+ *   print                 log the display contents
+ *   machine               apply every input in every state of every
+ *                         steep and compare with the table in
+ *                         machine.c; leaves all steeps at zero
+ *   battery <volts>       change the supply voltage, e.g. "2.65V"
+ *   remote write <reg> <bytes...>
+ *                         a host on the external connector writes
+ *                         to the registers, e.g. "remote write 0x0c 1"
+ *   remote read <reg> <n> it reads n registers from there on
+ *   expect remote "01 2c" compare the bytes of the last read, in hex
+ *   reset                 power cycle, only the EEPROM is kept; the
+ *                         times after it start from zero again
+ *   budget charge <uAh>   fail if the estimated charge is higher
+ *   budget wakeups <n>    fail on more than n interrupts in total
+ *   budget latency <us>   fail if any interrupt waited longer for its handler
+ * 
+ * Empty lines and everything after a '#' are ignored. For example:
+ * 
+ *   hold add 3s     # +10 s and two long-press steps of +1 min
+ *   tap set         # start the countdown
+ *   wait 90s
+ *   expect lcd "00:40"
+ * 
+ **/
+
+typedef enum {
+  step_press,
+  step_release,
+  step_expect_lcd,
+  step_expect_blink,
+  step_expect_led,
+  step_print,
+  step_machine,
+  step_battery,
+  step_remote_write,
+  step_remote_read,
+  step_expect_remote,
+  step_reset,
+  step_end,
+} step_kind;
+
+typedef struct {
+  sim_time at;
+  step_kind kind;
+  uint8_t pin;
+  char text[100]; // up to 32 bytes of a remote read in hex
+  int line;
+} step;
+
+static step *steps = NULL;
+static size_t count = 0;
+static size_t next = 0;
+
+int script_failures = 0;
+
+// the scenario as read, for the part after a reset
+static char **source = NULL;
+static int source_lines = 0;
+
+static void add(sim_time at, step_kind kind, uint8_t pin, const char *text, int line) {
+  steps = realloc(steps, (count + 1) * sizeof(step));
+  step *s = &steps[count++];
+  s->at = at;
+  s->kind = kind;
+  s->pin = pin;
+  s->line = line;
+  strncpy(s->text, text ? text : "", sizeof(s->text) - 1);
+  s->text[sizeof(s->text) - 1] = '\0';
+}
+
+// contact bounces on each change, see bounce
+static int bounces = 0;
+#define BOUNCE_INTERVAL (SIM_SECOND * 3 / 10000)
+
+// a press or release, preceded by bouncing if enabled
+static void change(sim_time at, bool pressed, uint8_t pin, int line) {
+  for (int i = 0; i < bounces; i++) {
+    add(at, pressed ? step_press : step_release, pin, NULL, line);
+    at += BOUNCE_INTERVAL;
+    add(at, pressed ? step_release : step_press, pin, NULL, line);
+    at += BOUNCE_INTERVAL;
+  }
+  add(at, pressed ? step_press : step_release, pin, NULL, line);
+}
+
+static void syntax(int line, const char *message) {
+  fprintf(stderr, "script line %d: %s\n", line, message);
+  exit(2);
+}
+
+// parse a duration like "250ms", "3s", "2m" or "1h"
+static sim_time duration(const char *arg, int line) {
+  if (arg == NULL) syntax(line, "missing time");
+  char *unit;
+  double value = strtod(arg, &unit);
+  if (unit == arg) syntax(line, "invalid time");
+  unit = strtok(unit, " \t");
+  if (unit == NULL) unit = "";
+  double scale = 0.001;
+  if (strcmp(unit, "s") == 0) scale = 1;
+  else if (strcmp(unit, "m") == 0) scale = 60;
+  else if (strcmp(unit, "h") == 0) scale = 3600;
+  else if (*unit != '\0' && strcmp(unit, "ms") != 0) syntax(line, "invalid time unit");
+  return (sim_time)(value * scale * SIM_SECOND);
+}
+
+static uint8_t button(const char *arg, int line) {
+  if (arg != NULL && strcmp(arg, "add") == 0) return SIM_BUTTON_ADD;
+  if (arg != NULL && strcmp(arg, "set") == 0) return SIM_BUTTON_SET;
+  syntax(line, "expected button add or set");
+  return 0;
+}
+
+// read the whole scenario from stdin
+void script_load() {
+
+  char buffer[128];
+  sim_time at = 0;
+  int line = 0;
+
+  // failures before a reset, see sim_reset()
+  const char *failures = getenv("SIM_FAILURES");
+  if (failures != NULL) script_failures = atoi(failures);
+
+  while (fgets(buffer, sizeof(buffer), stdin) != NULL) {
+
+    line++;
+    source = realloc(source, line * sizeof(char *));
+    source[line - 1] = strdup(buffer);
+    source_lines = line;
+    char *comment = strchr(buffer, '#');
+    if (comment != NULL) *comment = '\0';
+
+    char *cmd = strtok(buffer, " \t\r\n");
+    if (cmd == NULL) continue;
+    char *arg = strtok(NULL, " \t\r\n");
+    char *rest = strtok(NULL, "\r\n");
+
+    if (strcmp(cmd, "press") == 0) {
+      change(at, true, button(arg, line), line);
+    } else if (strcmp(cmd, "release") == 0) {
+      change(at, false, button(arg, line), line);
+    } else if (strcmp(cmd, "tap") == 0) {
+      change(at, true, button(arg, line), line);
+      at += SIM_MS(100);
+      change(at, false, button(arg, line), line);
+      at += SIM_MS(100);
+    } else if (strcmp(cmd, "hold") == 0) {
+      change(at, true, button(arg, line), line);
+      at += duration(rest, line);
+      change(at, false, button(arg, line), line);
+    } else if (strcmp(cmd, "bounce") == 0 && arg != NULL) {
+      bounces = atoi(arg);
+    } else if (strcmp(cmd, "wait") == 0) {
+      at += duration(arg, line);
+    } else if (strcmp(cmd, "budget") == 0 && arg != NULL && rest != NULL) {
+      char *end;
+      double value = strtod(rest, &end);
+      if (end == rest) syntax(line, "invalid budget");
+      if (strcmp(arg, "charge") == 0) sim_budget_uah = value;
+      else if (strcmp(arg, "wakeups") == 0) sim_budget_wakeups = (int64_t)value;
+      else if (strcmp(arg, "latency") == 0) sim_budget_latency_us = value;
+      else syntax(line, "expected charge, wakeups or latency");
+    } else if (strcmp(cmd, "battery") == 0 && arg != NULL) {
+      add(at, step_battery, 0, arg, line);
+    } else if (strcmp(cmd, "remote") == 0 && arg != NULL && rest != NULL) {
+      if (strcmp(arg, "write") == 0) add(at, step_remote_write, 0, rest, line);
+      else if (strcmp(arg, "read") == 0) add(at, step_remote_read, 0, rest, line);
+      else syntax(line, "expected remote write or read");
+    } else if (strcmp(cmd, "reset") == 0) {
+      add(at, step_reset, 0, NULL, line);
+    } else if (strcmp(cmd, "machine") == 0) {
+      add(at, step_machine, 0, "", line);
+    } else if (strcmp(cmd, "print") == 0) {
+      add(at, step_print, 0, NULL, line);
+    } else if (strcmp(cmd, "expect") == 0 && arg != NULL && rest != NULL) {
+      // strip whitespace around the expected value, and the quotes
+      // which keep the spaces inside, e.g. "45 ' "
+      while (*rest == ' ' || *rest == '\t') rest++;
+      char *e = rest + strlen(rest);
+      while (e > rest && (e[-1] == ' ' || e[-1] == '\t')) *--e = '\0';
+      if (*rest == '"' && e > rest + 1 && e[-1] == '"') {
+        rest++;
+        *--e = '\0';
+      }
+      if (strcmp(arg, "lcd") == 0) add(at, step_expect_lcd, 0, rest, line);
+      else if (strcmp(arg, "blink") == 0) add(at, step_expect_blink, 0, rest, line);
+      else if (strcmp(arg, "led") == 0) add(at, step_expect_led, 0, rest, line);
+      else if (strcmp(arg, "remote") == 0) add(at, step_expect_remote, 0, rest, line);
+      else syntax(line, "expected lcd, blink, led or remote");
+    } else {
+      syntax(line, "unknown command");
+    }
+
+  }
+
+  add(at, step_end, 0, NULL, line);
+
+}
+
+// time of the next step
+sim_time script_due() {
+  return next < count ? steps[next].at : SIM_NEVER;
+}
+
+// the register and the bytes of a remote command, returns their count
+static uint8_t numbers(const char *text, uint8_t *values, uint8_t max) {
+  uint8_t n = 0;
+  char *end;
+  for (long v = strtol(text, &end, 0); end != text && n < max; v = strtol(text, &end, 0)) {
+    values[n++] = (uint8_t)v;
+    text = end;
+  }
+  return n;
+}
+
+static void expect(const step *s, const char *actual) {
+  if (strcmp(s->text, actual) == 0) return;
+  sim_log("FAIL line %d: expected \"%s\", got \"%s\"", s->line, s->text, actual);
+  script_failures++;
+}
+
+// run the next step, returns true if an interrupt handler ran
+bool script_step() {
+
+  static const char *rates[] = { "off", "0.5Hz", "1Hz", "2Hz" };
+  const step *s = &steps[next++];
+
+  switch (s->kind) {
+    case step_press:
+      return sim_button(s->pin, true);
+    case step_release:
+      return sim_button(s->pin, false);
+    case step_expect_lcd:
+      expect(s, bu9796_text());
+      break;
+    case step_expect_blink:
+      expect(s, rates[bu9796_blink() & 0x03]);
+      break;
+    case step_expect_led:
+      expect(s, sim_led_state());
+      break;
+    case step_print:
+      sim_log("lcd \"%s\"", bu9796_text());
+      break;
+    case step_machine:
+      script_failures += machine_check();
+      return true;
+    case step_remote_write: {
+      uint8_t values[16];
+      uint8_t n = numbers(s->text, values, sizeof(values));
+      if (n > 0) sim_remote(values[0], &values[1], n - 1, 0);
+      break;
+    }
+    case step_remote_read: {
+      uint8_t values[2] = { 0, 1 };
+      numbers(s->text, values, 2);
+      sim_remote(values[0], NULL, 0, values[1]);
+      break;
+    }
+    case step_expect_remote:
+      expect(s, sim_remote_result());
+      break;
+    case step_battery:
+      sim_vdd = atof(s->text);
+      sim_log("battery %.2f V", sim_vdd);
+      break;
+    case step_reset: {
+      // the simulator starts over with everything after this line
+      FILE *rest = tmpfile();
+      if (rest == NULL) syntax(s->line, "no temporary file for the reset");
+      for (int i = s->line; i < source_lines; i++) fputs(source[i], rest);
+      sim_reset();
+      rewind(rest);
+      dup2(fileno(rest), STDIN_FILENO);
+      execl("/proc/self/exe", "teatime-sim", (char *)NULL);
+      perror("reset");
+      exit(2);
+    }
+    case step_end:
+      sim_finish();
+      break;
+  }
+  return false;
+
+}
@@ -0,0 +1,1264 @@
+// Host simulator for the teatime firmware
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "sim.h"
+#include "../lcddriver.h"
+#include "../display.h"
+#include "../i2c_controller.h"
+#include "../trace.h"
+
+/**
+ * The firmware's main() runs unchanged on the host. Whenever it calls
+ * sleep_cpu(), sim_sleep() applies the register writes of the code that
+ * ran since, then advances simulated time to the next event: a PIT tick,
+ * an RTC overflow, the end of an I2C byte or a step in the scenario
+ * script. The matching interrupt handler is called and sim_sleep()
+ * returns to the main loop, just like waking up on the target.
+ * 
+ * Code runs in zero simulated time, so scenarios of several hours
+ * complete in milliseconds and are fully deterministic.
+ * 
+ * The peripheral models follow the datasheet only as far as the
+ * firmware depends on them:
+ * 
+ *   - RTC counter with prescaler, period, overflow and compare match;
+ *     it runs in standby only with RUNSTDBY and not in power-down
+ *   - PIT with its period taps, running in all sleep modes
+ *   - the crystal with its startup time whenever it was stopped; the
+ *     RTC and PIT don't count on it until it's stable, the internal
+ *     32 kHz oscillator is taken as exact
+ *   - the errata where disabling either of RTC and PIT stops the other
+ *   - TWI host with byte timing from MBAUD, stalled in standby
+ *   - TWI target and a remote host on the same bus, driven by the
+ *     scenario, with arbitration between the two hosts
+ *   - pin change interrupts on PORTB, outputs on PORTA
+ *   - the DAC on the lcd's VLCD pin, only for its supply current
+ *   - the led alarm from PIT events and TCB0 single-shot pulses, as a
+ *     duty cycle
+ *   - ADC conversions of the internal reference against VDD, which is
+ *     set with the battery command of the scenario
+ *   - the voltage level monitor of the BOD, below its level only
+ *   - EEPROM page writes, which survive the reset command of the
+ *     scenario while uncommitted page buffer contents don't
+ * 
+ * At the end, the time spent in each sleep mode, the wakeups and the
+ * time the LED and LCD were powered are turned into an estimated
+ * charge, see the energy section below.
+ * 
+ **/
+
+
+// ---------- registers ---------- //
+
+CLKCTRL_t CLKCTRL;
+SLPCTRL_t SLPCTRL;
+static PORT_t ports[3];
+RTC_t RTC;
+VREF_t VREF;
+DAC_t DAC0;
+TCB_t TCB0;
+EVSYS_t EVSYS;
+ADC_t ADC0;
+CPUINT_t CPUINT;
+register8_t GPIOR0, GPIOR1, GPIOR2, GPIOR3;
+NVMCTRL_t NVMCTRL;
+uint8_t sim_eeprom[EEPROM_SIZE];
+// every run of the simulator starts with a power-on reset
+RSTCTRL_t RSTCTRL = { .RSTFR = RSTCTRL_PORF_bm };
+// as loaded from the fuses, see platformio.ini
+BOD_t BOD = { .CTRLA = BOD_ACTIVE_ENABLED_gc, .CTRLB = BOD_LVL_BODLEVEL0_gc };
+TWI_t TWI0 = { .MADDR = SIM_UNWRITTEN, .MDATA = SIM_UNWRITTEN };
+
+
+// ---------- state ---------- //
+
+sim_time sim_now = 0;
+
+// sleep modes for the statistics
+typedef enum { active = 0, idle, standby, powerdown, modes } sim_mode;
+static const char *mode_names[] = { "active", "idle", "standby", "power-down" };
+
+// interrupt sources for the statistics
+typedef enum { vec_pit = 0, vec_rtc, vec_portb, vec_twi, vec_adc, vec_bod, vec_twis, vectors } sim_vector;
+static const char *vector_names[] = { "RTC_PIT", "RTC_CNT", "PORTB_PORT", "TWI0_TWIM", "ADC0_RESRDY", "BOD_VLM", "TWI0_TWIS" };
+
+static struct {
+  uint32_t wakeups[vectors];
+  sim_time latency[vectors]; // worst time from the event to the handler
+  double handlers;    // seconds in handlers, at the clock of each
+  double handler_uas; // their charge in µA·s
+  sim_time sleeping[modes];
+  double sleep_uas[modes];
+  sim_time led;
+  double led_pulsed; // seconds of led current while pulsing
+  sim_time osc20m;
+  sim_time lcd;
+  double lcd_uas; // charge in µA·s, the current depends on the profile
+  sim_time dac;
+  sim_time adc;
+  sim_time bod;
+  uint32_t nvm_writes;
+  uint32_t nvm_pages[EEPROM_SIZE / EEPROM_PAGE_SIZE];
+  sim_time xosc;
+  sim_time twi_busy;
+  uint32_t twi_bytes;
+  uint32_t twi_stalls;
+  uint32_t twi_arblost;
+  uint32_t remote_bytes;
+  uint32_t remote_stalls;
+  uint32_t lcd_updates;
+} stats;
+
+// rtc counter between prescaled increments
+static uint16_t rtc_cnt = 0;
+static sim_time rtc_frac = 0;
+static bool pit_used = false;
+
+// crystal startup, SIM_NEVER while it's stopped
+static sim_time xosc_start = SIM_NEVER;
+#define XOSC_STARTUP SIM_MS(500) // rough, plus the 1k cycles of CSUT
+
+// startup trace: the first frame, the crystal and the wakeups
+static struct {
+  sim_time frame;
+  sim_time crystal;
+  sim_time rtc;
+  sim_time woken;     // the last wakeup from power-down
+  sim_time wake_max;  // worst time from there to the next frame
+  uint32_t wakes;
+} boot = { SIM_NEVER, SIM_NEVER, SIM_NEVER, SIM_NEVER, 0, 0 };
+
+// twi host
+static sim_time twi_done = SIM_NEVER;
+static bool twi_owner = false;
+static bool twi_acked = false;
+static bool twi_stalled = false;
+static uint8_t twi_address = 0;       // address byte of the current transaction
+static sim_time twi_started = SIM_NEVER;
+static int twi_waiting = -1;          // address byte held back while the bus is busy
+
+// adc conversion in progress
+static sim_time adc_done = SIM_NEVER;
+static bool adc_stalled = false;
+
+// supply voltage, set by the scenario
+double sim_vdd = 3.0;
+static bool vlm_warned = false;
+
+// eeprom contents as of the last page write, and when it's done
+static uint8_t eeprom_committed[EEPROM_SIZE];
+static sim_time nvm_done = 0;
+
+// button levels on PORTB
+static uint8_t buttons = 0;
+
+// last logged outputs
+static char last_text[16] = "";
+static uint8_t last_blink = LCD_BLKCTL_off;
+static const char *last_led = "off";
+
+
+// ---------- helpers ---------- //
+
+void sim_log(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  printf("[%5llu.%03llu] ",
+    (unsigned long long)(sim_now / SIM_SECOND),
+    (unsigned long long)(sim_now % SIM_SECOND * 1000 / SIM_SECOND));
+  vprintf(format, args);
+  printf("\n");
+  va_end(args);
+}
+
+static sim_mode sleep_mode() {
+  if (!(SLPCTRL.CTRLA & SLPCTRL_SEN_bm)) return active;
+  switch (SLPCTRL.CTRLA & SLPCTRL_SMODE_gm) {
+    case SLPCTRL_SMODE_IDLE_gc:  return idle;
+    case SLPCTRL_SMODE_STDBY_gc: return standby;
+    default:                     return powerdown;
+  }
+}
+
+// peripheral clock from the 20 MHz oscillator and prescaler
+static uint32_t clk_per() {
+  static const uint8_t div[16] = { 2, 4, 8, 16, 32, 64, 1, 1, 6, 10, 12, 24, 48, 1, 1, 1 };
+  if (!(CLKCTRL.MCLKCTRLB & CLKCTRL_PEN_bm)) return 20000000UL;
+  return 20000000UL / div[(CLKCTRL.MCLKCTRLB & CLKCTRL_PDIV_gm) >> 1];
+}
+
+// the led alarm, see led.c: pulses from TCB0 in single-shot mode on
+// each PIT event, returns the duty cycle or zero if not running
+static double led_pulses(sim_mode mode) {
+  if (!(TCB0.CTRLA & TCB_ENABLE_bm) || !(TCB0.CTRLB & TCB_CCMPEN_bm)) return 0;
+  if ((TCB0.CTRLB & TCB_CNTMODE_gm) != TCB_CNTMODE_SINGLE_gc || !(TCB0.EVCTRL & TCB_CAPTEI_bm)) return 0;
+  if (EVSYS.ASYNCUSER0 != EVSYS_ASYNCUSER0_ASYNCCH3_gc) return 0;
+  if (mode == powerdown || (mode == standby && !(TCB0.CTRLA & TCB_RUNSTDBY_bm))) return 0;
+  if (!(PORTA.DIR & PIN5_bm) || !(RTC.PITCTRLA & RTC_PITEN_bm) || !(RTC.CTRLA & RTC_RTCEN_bm)) return 0;
+  uint8_t div = EVSYS.ASYNCCH3 - EVSYS_ASYNCCH3_PIT_DIV8192_gc;
+  if (EVSYS.ASYNCCH3 < EVSYS_ASYNCCH3_PIT_DIV8192_gc || div > 7) return 0;
+  double rate = 4 << div;
+  uint32_t f = clk_per() / (((TCB0.CTRLA & TCB_CLKSEL_gm) == TCB_CLKSEL_CLKDIV2_gc) ? 2 : 1);
+  double duty = rate * TCB0.CCMP / f;
+  return duty < 1 ? duty : 1;
+}
+
+// a peripheral running in standby keeps the 20 MHz oscillator on
+static bool osc20m_standby(sim_mode mode) {
+  return mode == standby && (TCB0.CTRLA & TCB_ENABLE_bm) && (TCB0.CTRLA & TCB_RUNSTDBY_bm);
+}
+
+// the led as seen by the scenario: on, off or pulsing
+const char *sim_led_state() {
+  if (led_pulses(standby) > 0) return "pulsing";
+  return sim_led() ? "on" : "off";
+}
+
+bool sim_led() {
+  return (PORTA.DIR & PIN5_bm) && (PORTA.OUT & PIN5_bm);
+}
+
+static bool lcd_powered() {
+  return (PORTA.DIR & PIN7_bm) && (PORTA.OUT & PIN7_bm);
+}
+
+// the dac only keeps running in standby with RUNSTDBY
+static bool dac_running(sim_mode mode) {
+  if (!(DAC0.CTRLA & DAC_ENABLE_bm) || mode == powerdown) return false;
+  return mode != standby || (DAC0.CTRLA & DAC_RUNSTDBY_bm);
+}
+
+// see the energy section
+static const uint32_t handler_cycles[vectors];
+static double ua_mode(sim_mode mode);
+
+
+// ---------- latency ---------- //
+
+/**
+ * Handlers run in zero simulated time, so the latency from an event
+ * to its handler is estimated on a separate timeline: a sleeping cpu
+ * wakes up first, then the interrupt waits for a handler on the same
+ * or a higher level that is still running, see CPUINT. A level 1
+ * handler preempts level 0 and delays its end. Work in the main loop
+ * never delays an interrupt; its atomic sections are not modelled, and
+ * neither is the round-robin order of level 0.
+ **/
+
+#define LATENCY_RESPONSE 20 // cycles: response, pushing the pc and the handler prologue
+#define LATENCY_WAKEUP (SIM_SECOND * 12 / 1000000) // standby and power-down, rough estimate
+
+// cycles of each handler itself, without the main loop
+static const uint32_t isr_cycles[vectors] = {
+  [vec_pit]   = 40,
+  [vec_rtc]   = 40,  // clear the flag and post
+  [vec_portb] = 80,  // mute the pins and post
+  [vec_twi]   = 80,  // next byte, stop or repeated start
+  [vec_adc]   = 40,
+  [vec_bod]   = 40,
+  [vec_twis]  = 120, // one byte, or the copy of the registers
+};
+
+static const uint8_t vector_nums[vectors] = {
+  [vec_pit] = RTC_PIT_vect_num, [vec_rtc] = RTC_CNT_vect_num,
+  [vec_portb] = PORTB_PORT_vect_num, [vec_twi] = TWI0_TWIM_vect_num,
+  [vec_adc] = ADC0_RESRDY_vect_num, [vec_bod] = BOD_VLM_vect_num,
+  [vec_twis] = TWI0_TWIS_vect_num,
+};
+
+static sim_time running_until[2]; // handlers on level 0 and 1
+static bool waking = false;       // the cpu sleeps in standby or power-down
+
+static void latency(sim_vector v) {
+  uint8_t level = CPUINT.LVL1VEC == vector_nums[v] ? 1 : 0;
+  sim_time start = sim_now;
+  if (waking) start += LATENCY_WAKEUP;
+  waking = false;
+  for (uint8_t l = level; l < 2; l++) {
+    if (running_until[l] > start) start = running_until[l];
+  }
+  start += SIM_SECOND * LATENCY_RESPONSE / clk_per();
+  sim_time length = SIM_SECOND * isr_cycles[v] / clk_per();
+  if (level == 1 && running_until[0] > start) running_until[0] += length;
+  running_until[level] = start + length;
+  if (start - sim_now > stats.latency[v]) stats.latency[v] = start - sim_now;
+}
+
+// call an interrupt handler if the firmware defines one
+static bool vector(sim_vector v, void (*handler)(void)) {
+  if (handler == NULL) return false;
+  latency(v);
+  stats.wakeups[v]++;
+  double s = (double)handler_cycles[v] / clk_per();
+  stats.handlers += s;
+  stats.handler_uas += ua_mode(active) * s;
+  handler();
+  return true;
+}
+
+
+// ---------- rtc and pit ---------- //
+
+// datasheet errata: disabling either of RTC and PIT also stops the other
+static bool rtc_enabled() {
+  if (RTC.PITCTRLA & RTC_PITEN_bm) pit_used = true;
+  return (RTC.CTRLA & RTC_RTCEN_bm) && (!pit_used || (RTC.PITCTRLA & RTC_PITEN_bm));
+}
+
+static bool on_crystal() {
+  return (RTC.CLKSEL & RTC_CLKSEL_gm) == RTC_CLKSEL_TOSC32K_gc;
+}
+
+static bool xosc_stable() {
+  return xosc_start != SIM_NEVER && sim_now >= xosc_start + XOSC_STARTUP;
+}
+
+// the rtc is enabled and its clock is requested in this mode
+static bool rtc_clocked(sim_mode mode) {
+  if (!rtc_enabled()) return false;
+  if (mode == powerdown) return false;
+  if (mode == standby) return RTC.CTRLA & RTC_RUNSTDBY_bm;
+  return true;
+}
+
+static bool pit_enabled() {
+  return (RTC.PITCTRLA & RTC_PITEN_bm) && (RTC.CTRLA & RTC_RTCEN_bm)
+    && (RTC.PITCTRLA & RTC_PERIOD_gm);
+}
+
+static bool rtc_counting(sim_mode mode) {
+  return rtc_clocked(mode) && (!on_crystal() || xosc_stable());
+}
+
+static bool pit_running() {
+  return pit_enabled() && (!on_crystal() || xosc_stable());
+}
+
+// the crystal runs when forced with RUNSTDBY or requested by rtc or pit
+static bool xosc_requested(sim_mode mode) {
+  if (!(CLKCTRL.XOSC32KCTRLA & CLKCTRL_ENABLE_bm)) return false;
+  if (CLKCTRL.XOSC32KCTRLA & CLKCTRL_RUNSTDBY_bm) return true;
+  return on_crystal() && (rtc_clocked(mode) || pit_enabled());
+}
+
+// start or stop the crystal, returns the time it becomes stable
+static sim_time xosc_next(sim_mode mode) {
+  if (!xosc_requested(mode)) {
+    xosc_start = SIM_NEVER;
+    return SIM_NEVER;
+  }
+  if (xosc_start == SIM_NEVER) xosc_start = sim_now;
+  return xosc_stable() ? SIM_NEVER : xosc_start + XOSC_STARTUP;
+}
+
+static sim_time rtc_step() {
+  return SIM_CYCLE << ((RTC.CTRLA & RTC_PRESCALER_gm) >> RTC_PRESCALER_gp);
+}
+
+// time until the counter reaches a value, or SIM_NEVER
+static sim_time rtc_until(uint16_t value) {
+  uint32_t top = (uint32_t)RTC.PER + 1;
+  uint32_t steps = (value + top - rtc_cnt % top) % top;
+  if (steps == 0) steps = top;
+  return steps * rtc_step() - rtc_frac;
+}
+
+static sim_time rtc_next(sim_mode mode) {
+  if (!rtc_counting(mode)) return SIM_NEVER;
+  sim_time next = SIM_NEVER;
+  if (RTC.INTCTRL & RTC_OVF_bm) {
+    // overflow is the increment from PER back to zero
+    sim_time t = rtc_until(0);
+    if (t < next) next = t;
+  }
+  if (RTC.INTCTRL & RTC_CMP_bm) {
+    sim_time t = rtc_until(RTC.CMP);
+    if (t < next) next = t;
+  }
+  return next == SIM_NEVER ? next : sim_now + next;
+}
+
+static sim_time pit_next() {
+  if (!pit_running() || !(RTC.PITINTCTRL & RTC_PI_bm)) return SIM_NEVER;
+  sim_time period = SIM_CYCLE << (((RTC.PITCTRLA & RTC_PERIOD_gm) >> RTC_PERIOD_gp) + 1);
+  return (sim_now / period + 1) * period;
+}
+
+static void rtc_advance(sim_time dt, sim_mode mode) {
+  if (!rtc_counting(mode)) return;
+  uint32_t top = (uint32_t)RTC.PER + 1;
+  rtc_frac += dt;
+  uint64_t steps = rtc_frac / rtc_step();
+  rtc_frac %= rtc_step();
+  rtc_cnt = (rtc_cnt + steps) % top;
+}
+
+
+// ---------- twi ---------- //
+
+static sim_time twi_byte() {
+  // f_scl = f_cpu / (10 + 2·BAUD + f_cpu·t_rise), see i2c_controller.h
+  uint32_t f = clk_per();
+  uint64_t div = 10 + 2 * (uint64_t)TWI0.MBAUD + (uint64_t)f * T_RISE / 1000000000ULL;
+  return 9 * SIM_SECOND * div / f;
+}
+
+static bool remote_on_bus();
+static void remote_bus_free();
+
+static void twi_start(uint8_t addr) {
+  // a repeated start ends the previous transaction as well
+  if (twi_owner && twi_acked) bu9796_stop();
+  twi_owner = true;
+  twi_address = addr;
+  twi_started = sim_now;
+  twi_acked = (addr >> 1) == LCD_ADDRESS && !(addr & 1) && lcd_powered();
+  if (twi_acked) bu9796_start();
+  twi_done = sim_now + twi_byte();
+  stats.twi_busy += twi_byte();
+  stats.twi_bytes++;
+}
+
+static void twi_sync() {
+
+  // a disabled controller ignores everything
+  if (!(TWI0.MCTRLA & TWI_ENABLE_bm)) {
+    if (TWI0.MADDR != SIM_UNWRITTEN || TWI0.MDATA != SIM_UNWRITTEN) {
+      sim_log("warning: twi written while disabled");
+    }
+    TWI0.MADDR = TWI0.MDATA = SIM_UNWRITTEN;
+    TWI0.MSTATUS = TWI_BUSSTATE_UNKNOWN_gc;
+    return;
+  }
+
+  if (TWI0.MADDR != SIM_UNWRITTEN) {
+    uint8_t addr = TWI0.MADDR;
+    TWI0.MADDR = SIM_UNWRITTEN;
+    // the start waits until the remote host releases the bus
+    if (remote_on_bus()) {
+      twi_waiting = addr;
+    } else {
+      twi_start(addr);
+    }
+  }
+
+  if (TWI0.MDATA != SIM_UNWRITTEN) {
+    uint8_t data = TWI0.MDATA;
+    TWI0.MDATA = SIM_UNWRITTEN;
+    if (twi_acked) bu9796_write(data);
+    twi_done = sim_now + twi_byte();
+    stats.twi_busy += twi_byte();
+    stats.twi_bytes++;
+  }
+
+  if ((TWI0.MCTRLB & TWI_MCMD_gm) == TWI_MCMD_STOP_gc) {
+    if (twi_owner && twi_acked) {
+      bu9796_stop();
+      stats.lcd_updates++;
+    }
+    twi_owner = twi_acked = false;
+    twi_done = SIM_NEVER;
+    remote_bus_free();
+  }
+  TWI0.MCTRLB &= ~TWI_MCMD_gm;
+
+  if (twi_owner) TWI0.MSTATUS = TWI_BUSSTATE_OWNER_gc;
+  else if (remote_on_bus() || twi_waiting >= 0) TWI0.MSTATUS = TWI_BUSSTATE_BUSY_gc;
+  else TWI0.MSTATUS = TWI_BUSSTATE_IDLE_gc;
+
+}
+
+static sim_time twi_next(sim_mode mode) {
+  if (twi_done == SIM_NEVER) return SIM_NEVER;
+  // the twi host needs the peripheral clock
+  if (mode != active && mode != idle) {
+    if (!twi_stalled) {
+      sim_log("warning: twi transfer stalled in %s", mode_names[mode]);
+      stats.twi_stalls++;
+    }
+    twi_stalled = true;
+    return SIM_NEVER;
+  }
+  twi_stalled = false;
+  return twi_done > sim_now ? twi_done : sim_now;
+}
+
+static bool twi_fire() {
+  twi_done = SIM_NEVER;
+  TWI0.MSTATUS = TWI_WIF_bm | (twi_acked ? 0 : TWI_RXACK_bm) | TWI_BUSSTATE_OWNER_gc;
+  if (!(TWI0.MCTRLA & TWI_WIEN_bm)) return false;
+  return vector(vec_twi, TWI0_TWIM_vect);
+}
+
+// the other host won the arbitration during our address byte
+static bool twi_lose() {
+  twi_owner = twi_acked = false;
+  twi_done = SIM_NEVER;
+  stats.twi_arblost++;
+  sim_log("twi arbitration lost");
+  TWI0.MSTATUS = TWI_ARBLOST_bm | TWI_WIF_bm | TWI_BUSSTATE_BUSY_gc;
+  if (!(TWI0.MCTRLA & TWI_WIEN_bm)) return false;
+  return vector(vec_twi, TWI0_TWIM_vect);
+}
+
+
+// ---------- remote host ---------- //
+
+/**
+ * Another host on the external connector, driven by the scenario. At
+ * 100 kHz, it writes the register pointer and then either the bytes
+ * to write or, after a repeated start, reads the given number of
+ * bytes. The bus is shared with the twi host above: whoever starts
+ * first owns it until the stop and the other one waits. When both
+ * start within the same bit, the lower address byte wins. The address
+ * match wakes the target from any sleep mode, but the data bytes and
+ * the stop need the peripheral clock; without it, the target stretches
+ * the clock and the transfer stalls.
+ **/
+
+#define REMOTE_BYTE (SIM_SECOND * 9 / 100000) // 9 bits at 100 kHz
+#define REMOTE_OPS 40
+
+typedef enum { op_start, op_write, op_restart, op_read, op_nack, op_stop } remote_op;
+
+static struct {
+  remote_op ops[REMOTE_OPS];
+  uint8_t data[REMOTE_OPS];
+  uint8_t count, at;
+  sim_time due;     // next bus event, SIM_NEVER while idle or waiting
+  bool waiting;     // for the twi host to release the bus
+  bool on_bus;
+  bool acked;       // the target acknowledged its address
+  bool stalled;
+  char result[3 * REMOTE_OPS + 1];
+} remote = { .due = SIM_NEVER };
+
+static bool remote_on_bus() {
+  return remote.on_bus;
+}
+
+// the twi host sent its stop, a waiting remote host starts now
+static void remote_bus_free() {
+  if (!remote.waiting) return;
+  remote.waiting = false;
+  remote.due = sim_now + REMOTE_BYTE;
+}
+
+static void remote_add(remote_op op, uint8_t data) {
+  if (remote.count >= REMOTE_OPS) return;
+  remote.ops[remote.count] = op;
+  remote.data[remote.count++] = data;
+}
+
+// start a transaction of the scenario, see sim.h
+void sim_remote(uint8_t reg, const uint8_t *data, uint8_t writes, uint8_t reads) {
+  if (remote.due != SIM_NEVER || remote.waiting || remote.on_bus) {
+    sim_log("warning: remote host busy, transaction skipped");
+    return;
+  }
+  remote.count = remote.at = 0;
+  remote_add(op_start, I2C_TARGET_ADDRESS << 1);
+  remote_add(op_write, reg);
+  for (uint8_t i = 0; i < writes; i++) remote_add(op_write, data[i]);
+  if (reads > 0) {
+    remote_add(op_restart, I2C_TARGET_ADDRESS << 1 | 1);
+    for (uint8_t i = 0; i < reads && remote.count < REMOTE_OPS - 2; i++) remote_add(op_read, 0xFF);
+    remote_add(op_nack, 0);
+  }
+  remote_add(op_stop, 0);
+  remote.result[0] = '\0';
+  remote.due = sim_now;
+}
+
+// the bytes of the last read as hex, e.g. "01 2c 01"
+const char *sim_remote_result() {
+  return remote.result;
+}
+
+// the target only sees the bus with its pins enabled, see lcd_power_off()
+static bool target_listening() {
+  return (TWI0.SCTRLA & TWI_ENABLE_bm)
+    && (TWI0.SADDR >> 1) == I2C_TARGET_ADDRESS
+    && (PORTB.PIN0CTRL & PORT_ISC_gm) != PORT_ISC_INPUT_DISABLE_gc
+    && (PORTB.PIN1CTRL & PORT_ISC_gm) != PORT_ISC_INPUT_DISABLE_gc;
+}
+
+// hand a bus event to the target, returns its response command
+static uint8_t target_event(uint8_t status, bool *woken) {
+  uint8_t enable = TWI_DIEN_bm;
+  if (status & TWI_APIF_bm) enable = (status & TWI_AP_bm) ? TWI_APIEN_bm : TWI_PIEN_bm;
+  TWI0.SSTATUS = status;
+  TWI0.SCTRLB = 0;
+  if (!(TWI0.SCTRLA & enable)) return TWI_SCMD_NOACT_gc;
+  *woken |= vector(vec_twis, TWI0_TWIS_vect);
+  uint8_t response = TWI0.SCTRLB;
+  TWI0.SCTRLB = 0;
+  return response;
+}
+
+static bool target_acked(uint8_t response) {
+  return (response & TWI_SCMD_gm) == TWI_SCMD_RESPONSE_gc && !(response & TWI_ACKACT_bm);
+}
+
+static bool needs_clock(remote_op op) {
+  if (op == op_start || op == op_restart) return false;
+  return op != op_stop || remote.acked;
+}
+
+static sim_time remote_next(sim_mode mode) {
+  if (remote.due == SIM_NEVER) return SIM_NEVER;
+  if (needs_clock(remote.ops[remote.at]) && mode != active && mode != idle) {
+    if (!remote.stalled) {
+      sim_log("warning: remote transfer stalled in %s", mode_names[mode]);
+      stats.remote_stalls++;
+    }
+    remote.stalled = true;
+    return SIM_NEVER;
+  }
+  remote.stalled = false;
+  return remote.due > sim_now ? remote.due : sim_now;
+}
+
+static bool remote_fire() {
+
+  remote_op op = remote.ops[remote.at];
+  uint8_t data = remote.data[remote.at];
+  bool woken = false;
+
+  // the bus is taken, unless both hosts start at once and ours loses
+  if (op == op_start && twi_owner) {
+    bool wins = sim_now - twi_started < twi_byte() / 9 && data < twi_address;
+    if (!wins) {
+      remote.waiting = true;
+      remote.due = SIM_NEVER;
+      return false;
+    }
+    woken |= twi_lose();
+  }
+  if (op == op_start) remote.on_bus = true;
+
+  stats.remote_bytes++;
+  if (lcd_powered()) stats.twi_busy += REMOTE_BYTE;
+
+  bool nack = false;
+  uint8_t response;
+  switch (op) {
+    case op_start:
+    case op_restart:
+      remote.acked = target_listening()
+        && target_acked(target_event(TWI_APIF_bm | TWI_AP_bm | ((data & 1) ? TWI_DIR_bm : 0), &woken));
+      nack = !remote.acked;
+      break;
+    case op_write:
+      TWI0.SDATA = data;
+      nack = !target_acked(target_event(TWI_DIF_bm, &woken));
+      break;
+    case op_read:
+      // the host acknowledges all bytes but the last one
+      TWI0.SDATA = 0xFF;
+      response = target_event(TWI_DIF_bm | TWI_DIR_bm, &woken);
+      data = ((response & TWI_SCMD_gm) == TWI_SCMD_RESPONSE_gc) ? TWI0.SDATA : 0xFF;
+      sprintf(remote.result + strlen(remote.result), remote.result[0] ? " %02x" : "%02x", data);
+      break;
+    case op_nack:
+      target_event(TWI_DIF_bm | TWI_DIR_bm | TWI_RXACK_bm, &woken);
+      break;
+    case op_stop:
+      if (remote.acked) target_event(TWI_APIF_bm, &woken);
+      remote.on_bus = remote.acked = false;
+      if (twi_waiting >= 0) {
+        twi_start(twi_waiting);
+        twi_waiting = -1;
+      }
+      break;
+  }
+
+  // a missing acknowledge ends the transaction
+  if (nack) {
+    sim_log("remote nack");
+    remote.at = remote.count - 1;
+  } else {
+    remote.at++;
+  }
+  if (remote.at < remote.count) {
+    remote.due = sim_now + REMOTE_BYTE;
+  } else {
+    remote.due = SIM_NEVER;
+    if (remote.result[0]) sim_log("remote read %s", remote.result);
+  }
+  return woken;
+
+}
+
+
+// ---------- adc ---------- //
+
+// a write to COMMAND starts a conversion, which takes the initial delay
+// and 13 ADC clocks per accumulated sample
+static void adc_sync() {
+  if (!(ADC0.CTRLA & ADC_ENABLE_bm)) {
+    ADC0.COMMAND = 0;
+    adc_done = SIM_NEVER;
+    return;
+  }
+  if (!(ADC0.COMMAND & ADC_STCONV_bm) || adc_done != SIM_NEVER) return;
+  static const uint16_t delay[8] = { 0, 16, 32, 64, 128, 256, 0, 0 };
+  uint32_t f = clk_per() / (2 << (ADC0.CTRLC & ADC_PRESC_gm));
+  uint32_t cycles = delay[ADC0.CTRLD >> 5] + 13 * (1 << (ADC0.CTRLB & ADC_SAMPNUM_gm));
+  adc_done = sim_now + (sim_time)cycles * SIM_SECOND / f;
+}
+
+static sim_time adc_next(sim_mode mode) {
+  if (adc_done == SIM_NEVER) return SIM_NEVER;
+  // the adc needs the peripheral clock, in standby only with RUNSTBY
+  if (mode == powerdown || (mode == standby && !(ADC0.CTRLA & ADC_RUNSTBY_bm))) {
+    if (!adc_stalled) sim_log("warning: adc conversion stalled in %s", mode_names[mode]);
+    adc_stalled = true;
+    return SIM_NEVER;
+  }
+  adc_stalled = false;
+  return adc_done > sim_now ? adc_done : sim_now;
+}
+
+// only the internal reference against VDD is modelled
+static bool adc_fire() {
+  adc_done = SIM_NEVER;
+  ADC0.COMMAND = 0;
+  uint32_t samples = 1 << (ADC0.CTRLB & ADC_SAMPNUM_gm);
+  uint32_t sample = 1023;
+  if ((ADC0.MUXPOS == ADC_MUXPOS_INTREF_gc) && (ADC0.CTRLC & ADC_REFSEL_gm) == ADC_REFSEL_VDDREF_gc) {
+    sample = (uint32_t)(1.1 / sim_vdd * 1023 + 0.5);
+    if (sample > 1023) sample = 1023;
+  }
+  ADC0.RES = sample * samples;
+  ADC0.INTFLAGS = ADC_RESRDY_bm;
+  if (!(ADC0.INTCTRL & ADC_RESRDY_bm)) return false;
+  return vector(vec_adc, ADC0_RESRDY_vect);
+}
+
+
+// ---------- bod ---------- //
+
+// brown-out levels selected by BOD.CTRLB, the others are reserved
+static double bod_level() {
+  switch (BOD.CTRLB & BOD_LVL_gm) {
+    case BOD_LVL_BODLEVEL2_gc: return 2.6;
+    case BOD_LVL_BODLEVEL7_gc: return 4.3;
+    default:                   return 1.8;
+  }
+}
+
+static double vlm_level() {
+  static const double above[4] = { 1.05, 1.15, 1.25, 1.25 };
+  return bod_level() * above[BOD.VLMCTRLA & BOD_VLMLVL_gm];
+}
+
+// the detector runs in active mode as set by the fuses, in sleep as
+// set by the firmware
+static bool bod_enabled(sim_mode mode) {
+  if (mode == active || mode == idle) return (BOD.CTRLA & BOD_ACTIVE_gm) != BOD_ACTIVE_DIS_gc;
+  return (BOD.CTRLA & BOD_SLEEP_gm) != BOD_SLEEP_DIS_gc;
+}
+
+static bool bod_sampled(sim_mode mode) {
+  return (mode == standby || mode == powerdown) && (BOD.CTRLA & BOD_SLEEP_gm) == BOD_SLEEP_SAMPLED_gc;
+}
+
+// the voltage level monitor fires once when the supply falls below it
+static bool bod_fire(sim_mode mode) {
+  bool below = sim_vdd < vlm_level();
+  BOD.STATUS = below ? BOD_VLMS_bm : 0;
+  if (!below) vlm_warned = false;
+  if (!below || vlm_warned || !bod_enabled(mode)) return false;
+  vlm_warned = true;
+  sim_log("bod below %.2f V", vlm_level());
+  BOD.INTFLAGS = BOD_VLMIF_bm;
+  if (!(BOD.INTCTRL & BOD_VLMIE_bm)) return false;
+  return vector(vec_bod, BOD_VLM_vect);
+}
+
+
+// ---------- nvm ---------- //
+
+#define NVM_PAGE_WRITE SIM_MS(4) // erase and write of one eeprom page
+
+// the erased eeprom, or the one saved before a reset
+__attribute__((constructor)) static void nvm_init() {
+  memset(eeprom_committed, 0xFF, EEPROM_SIZE);
+  const char *path = getenv("SIM_EEPROM");
+  if (path != NULL) {
+    FILE *f = fopen(path, "rb");
+    if (f != NULL) {
+      if (fread(eeprom_committed, 1, EEPROM_SIZE, f) != EEPROM_SIZE) sim_log("warning: short eeprom file");
+      fclose(f);
+    }
+    remove(path);
+  }
+  memcpy(sim_eeprom, eeprom_committed, EEPROM_SIZE);
+}
+
+// a command commits the pages that were written since the last one
+static void nvm_sync() {
+  uint8_t cmd = NVMCTRL.CTRLA & NVMCTRL_CMD_gm;
+  NVMCTRL.CTRLA = 0;
+  NVMCTRL.STATUS = 0;
+  if (cmd == NVMCTRL_CMD_NONE_gc) return;
+  if (cmd != NVMCTRL_CMD_PAGEERASEWRITE_gc) {
+    sim_log("warning: nvm command %u not simulated", cmd);
+    return;
+  }
+  // the firmware would have waited for the previous write
+  if (sim_now < nvm_done) sim_log("warning: nvm busy, write delayed");
+  nvm_done = (sim_now > nvm_done ? sim_now : nvm_done) + NVM_PAGE_WRITE;
+  for (uint8_t page = 0; page < EEPROM_SIZE / EEPROM_PAGE_SIZE; page++) {
+    uint8_t *p = &eeprom_committed[page * EEPROM_PAGE_SIZE];
+    if (memcmp(p, &sim_eeprom[page * EEPROM_PAGE_SIZE], EEPROM_PAGE_SIZE) == 0) continue;
+    memcpy(p, &sim_eeprom[page * EEPROM_PAGE_SIZE], EEPROM_PAGE_SIZE);
+    stats.nvm_pages[page]++;
+    stats.nvm_writes++;
+  }
+}
+
+
+// ---------- ports ---------- //
+
+// apply pending strobe register writes before each access
+PORT_t *sim_port(uint8_t index) {
+  PORT_t *p = &ports[index];
+  p->DIR = ((p->DIR | p->DIRSET) & ~p->DIRCLR) ^ p->DIRTGL;
+  p->OUT = ((p->OUT | p->OUTSET) & ~p->OUTCLR) ^ p->OUTTGL;
+  p->DIRSET = p->DIRCLR = p->DIRTGL = 0;
+  p->OUTSET = p->OUTCLR = p->OUTTGL = 0;
+  return p;
+}
+
+static void ports_sync() {
+  for (uint8_t i = 0; i < 3; i++) {
+    sim_port(i)->INTFLAGS = 0;
+  }
+  PORTA.IN = PORTA.OUT & PORTA.DIR;
+  PORTB.IN = (buttons & ~PORTB.DIR) | (PORTB.OUT & PORTB.DIR);
+  bu9796_power(lcd_powered());
+}
+
+static uint8_t pin_sense(uint8_t pin) {
+  register8_t *ctrl = &PORTB.PIN0CTRL;
+  for (uint8_t i = 0; i < 8; i++) {
+    if (pin == (1 << i)) return ctrl[i] & PORT_ISC_gm;
+  }
+  return PORT_ISC_INTDISABLE_gc;
+}
+
+// change a button level and fire the pin change interrupt
+bool sim_button(uint8_t pin, bool pressed) {
+  if (pressed == !!(buttons & pin)) return false;
+  buttons = pressed ? (buttons | pin) : (buttons & ~pin);
+  PORTB.IN = (buttons & ~PORTB.DIR) | (PORTB.OUT & PORTB.DIR);
+  uint8_t sense = pin_sense(pin);
+  bool fire = sense == PORT_ISC_BOTHEDGES_gc
+    || (sense == PORT_ISC_RISING_gc && pressed)
+    || (sense == PORT_ISC_FALLING_gc && !pressed)
+    || (sense == PORT_ISC_LEVEL_gc && !pressed);
+  if (!fire) return false;
+  PORTB.INTFLAGS = pin;
+  return vector(vec_portb, PORTB_PORT_vect);
+}
+
+
+// ---------- main loop ---------- //
+
+// apply the side effects of register writes since the last step
+static void sync() {
+
+  ports_sync();
+  twi_sync();
+  adc_sync();
+  nvm_sync();
+
+  // the rtc counter was written
+  if (RTC.CNT != rtc_cnt) {
+    rtc_cnt = RTC.CNT;
+    rtc_frac = 0;
+  }
+  RTC.STATUS = 0;
+  RTC.PITSTATUS = 0;
+  RTC.INTFLAGS = 0;
+  RTC.PITINTFLAGS = 0;
+
+  // the crystal's status, it keeps running while the cpu is awake
+  xosc_next(active);
+  if (xosc_stable()) {
+    CLKCTRL.MCLKSTATUS |= CLKCTRL_XOSC32KS_bm;
+  } else {
+    CLKCTRL.MCLKSTATUS &= ~CLKCTRL_XOSC32KS_bm;
+  }
+  if (xosc_stable() && boot.crystal == SIM_NEVER) boot.crystal = sim_now;
+  if (on_crystal() && boot.rtc == SIM_NEVER) boot.rtc = sim_now;
+
+  // log visible changes, once the transaction has ended
+  const char *text = bu9796_text();
+  if (!twi_owner && strcmp(text, last_text) != 0) {
+    if (boot.frame == SIM_NEVER) boot.frame = sim_now;
+    if (boot.woken != SIM_NEVER) {
+      if (sim_now - boot.woken > boot.wake_max) boot.wake_max = sim_now - boot.woken;
+      boot.woken = SIM_NEVER;
+    }
+    sim_log("lcd \"%s\"", text);
+    strncpy(last_text, text, sizeof(last_text) - 1);
+  }
+  if (!twi_owner && bu9796_blink() != last_blink) {
+    static const char *rates[] = { "off", "0.5Hz", "1Hz", "2Hz" };
+    last_blink = bu9796_blink();
+    sim_log("lcd blink %s", rates[last_blink]);
+  }
+  if (strcmp(sim_led_state(), last_led) != 0) {
+    last_led = sim_led_state();
+    sim_log("led %s", last_led);
+  }
+
+}
+
+// let time pass while sleeping
+static void advance(sim_time until, sim_mode mode) {
+  sim_time dt = until - sim_now;
+  stats.sleeping[mode] += dt;
+  stats.sleep_uas[mode] += ua_mode(mode) * dt / SIM_SECOND;
+  double duty = led_pulses(mode);
+  if (duty > 0) stats.led_pulsed += duty * dt / SIM_SECOND;
+  else if (sim_led()) stats.led += dt;
+  if (osc20m_standby(mode)) stats.osc20m += dt;
+  if (lcd_powered()) {
+    stats.lcd += dt;
+    stats.lcd_uas += bu9796_current() * dt / SIM_SECOND;
+  }
+  if (dac_running(mode)) stats.dac += dt;
+  if (adc_done != SIM_NEVER && !adc_stalled) stats.adc += dt;
+  if (bod_sampled(mode)) stats.bod += dt;
+  if (xosc_start != SIM_NEVER) stats.xosc += dt;
+  rtc_advance(dt, mode);
+  sim_now = until;
+  RTC.CNT = rtc_cnt;
+}
+
+void sim_sleep() {
+
+  static bool started = false;
+  if (!started) {
+    started = true;
+    script_load();
+  }
+
+  sync();
+  sim_mode mode = sleep_mode();
+  waking = mode == standby || mode == powerdown;
+
+  for (;;) {
+
+    // find the next event
+    sim_time t_pit = pit_next();
+    sim_time t_rtc = rtc_next(mode);
+    sim_time t_twi = twi_next(mode);
+    sim_time t_remote = remote_next(mode);
+    sim_time t_adc = adc_next(mode);
+    sim_time t_xosc = xosc_next(mode);
+    sim_time t_script = script_due();
+    if (t_script == SIM_NEVER) sim_finish();
+    sim_time next = t_pit;
+    if (t_rtc < next) next = t_rtc;
+    if (t_twi < next) next = t_twi;
+    if (t_remote < next) next = t_remote;
+    if (t_adc < next) next = t_adc;
+    if (t_xosc < next) next = t_xosc;
+
+    // scenario steps come after hardware events at the same time
+    if (t_script < next) {
+      advance(t_script, mode);
+      bool woken = script_step();
+      woken |= bod_fire(mode);
+      if (woken && mode == powerdown) {
+        boot.woken = sim_now;
+        boot.wakes++;
+      }
+      sync();
+      if (woken) return;
+      continue;
+    }
+    advance(next, mode);
+
+    bool woken = false;
+    if (next == t_twi) {
+      woken |= twi_fire();
+    }
+    if (next == t_remote) {
+      woken |= remote_fire();
+    }
+    if (next == t_adc) {
+      woken |= adc_fire();
+    }
+    if (next == t_rtc) {
+      uint8_t flags = 0;
+      if ((RTC.INTCTRL & RTC_OVF_bm) && rtc_cnt == 0 && rtc_frac == 0) flags |= RTC_OVF_bm;
+      if ((RTC.INTCTRL & RTC_CMP_bm) && rtc_cnt == RTC.CMP) flags |= RTC_CMP_bm;
+      RTC.INTFLAGS = flags;
+      if (flags) woken |= vector(vec_rtc, RTC_CNT_vect);
+    }
+    if (next == t_pit && (RTC.PITINTCTRL & RTC_PI_bm)) {
+      RTC.PITINTFLAGS = RTC_PI_bm;
+      woken |= vector(vec_pit, RTC_PIT_vect);
+    }
+    // the detector is on again once awake
+    if (woken) bod_fire(active);
+    sync();
+    if (woken) return;
+
+  }
+
+}
+
+
+// ---------- energy ---------- //
+
+/**
+ * Typical supply currents at 3 V and 25 °C. The ATtiny417 figures are
+ * from the datasheet's power consumption tables, the crystal is counted
+ * separately whenever the rtc or the pit requests it. Active and idle
+ * are given at 10 MHz; at other clock points, the 20 MHz oscillator
+ * stays and the rest is taken as proportional to the clock. The LED current follows from the 2.2 kΩ
+ * series resistor, the bus current from the two 10 kΩ pull-ups being
+ * low about half of the time. These are estimates, not measurements.
+ **/
+
+#define UA_ACTIVE     2600.0 // active at 10 MHz
+#define UA_IDLE       1000.0 // idle at 10 MHz, peripherals running
+#define UA_STANDBY       0.1 // standby, everything stopped
+#define UA_POWERDOWN     0.1 // power-down
+#define UA_XOSC32K       0.6 // crystal and rtc or pit, while running
+#define UA_LED         500.0 // (3.0 V - 1.9 V) / 2.2 kΩ
+#define UA_DAC          50.0 // dac0 with its reference, rough estimate
+#define UA_ADC         400.0 // adc0, reference and the 20 MHz oscillator in standby
+#define UA_OSC20M      125.0 // 20 MHz oscillator kept on in standby
+#define UA_TWI         300.0 // 3.0 V / 10 kΩ, two lines low half the time
+#define UA_BOD_SAMPLED   1.0 // bod sampled at 125 Hz in sleep, rough estimate
+#define UA_NVM        2000.0 // eeprom erase/write with the clock kept on, rough estimate
+
+static const double ua_modes[modes] = { UA_ACTIVE, UA_IDLE, UA_STANDBY, UA_POWERDOWN };
+
+static double ua_mode(sim_mode mode) {
+  if (mode != active && mode != idle) return ua_modes[mode];
+  return UA_OSC20M + (ua_modes[mode] - UA_OSC20M) * clk_per() / 10e6;
+}
+
+/**
+ * Handlers run in zero simulated time, so their length is estimated
+ * in cycles, including the wakeup and the trip through the main loop.
+ * Their time follows from the clock at the wakeup.
+ * Measure them on the target with -D PROFILE (see profile.h) and
+ * update this table when the handlers change substantially.
+ **/
+// every vector that posts an event also pays for publish(), about
+// 800 cycles: remaining(), two bcd_to_seconds() without a hardware
+// multiplier and the copy of the map; up to 2300 while coarse()
+#define PUBLISH_CYCLES 800
+
+static const uint32_t handler_cycles[vectors] = {
+  [vec_pit]   = 900, // tick(), display_time() and queueing the frame
+  [vec_rtc]   = 700 + PUBLISH_CYCLES, // dispatch(), tick() or a button deadline, display_time()
+  [vec_portb] = 900 + PUBLISH_CYCLES, // button_*(), display_time() and queueing the frame
+  [vec_twi]   = 150, // next byte, stop or repeated start; no event, no publish()
+  [vec_adc]   = 700 + PUBLISH_CYCLES, // 32 bit division, filter and battery_measured()
+  [vec_bod]   = 1200 + PUBLISH_CYCLES, // storage_collect(), crc and loading the page buffer
+  [vec_twis]  = 200, // one byte of the register map, or its copy at the address match
+};
+
+// budgets set by the scenario, checked when it ends
+double sim_budget_uah = -1;
+int64_t sim_budget_wakeups = -1;
+double sim_budget_latency_us = -1;
+
+static uint32_t total_wakeups() {
+  uint32_t n = 0;
+  for (uint8_t v = 0; v < vectors; v++) n += stats.wakeups[v];
+  return n;
+}
+
+static double seconds(sim_time t) {
+  return (double)t / SIM_SECOND;
+}
+
+static double uah(double ua, double s) {
+  return ua * s / 3600;
+}
+
+// print the charge estimate and return the total in µAh
+static double energy() {
+
+  double total = 0, part;
+  printf("charge (estimated, typical currents at 3 V):\n");
+  part = stats.handler_uas / 3600;
+  total += part;
+  printf("  %-12s %12.6f s  %9.4f uAh\n", "handlers", stats.handlers, part);
+  for (uint8_t m = 0; m < modes; m++) {
+    part = stats.sleep_uas[m] / 3600;
+    total += part;
+    printf("  %-12s %12.3f s  %9.4f uAh\n", mode_names[m], seconds(stats.sleeping[m]), part);
+  }
+  part = uah(UA_XOSC32K, seconds(stats.xosc));
+  total += part;
+  printf("  %-12s %12.3f s  %9.4f uAh\n", "crystal", seconds(stats.xosc), part);
+  part = uah(UA_TWI, seconds(stats.twi_busy));
+  total += part;
+  printf("  %-12s %12.6f s  %9.4f uAh\n", "i2c bus", seconds(stats.twi_busy), part);
+  part = stats.lcd_uas / 3600;
+  total += part;
+  printf("  %-12s %12.3f s  %9.4f uAh\n", "lcd", seconds(stats.lcd), part);
+  if (stats.dac) {
+    part = uah(UA_DAC, seconds(stats.dac));
+    total += part;
+    printf("  %-12s %12.3f s  %9.4f uAh\n", "vlcd dac", seconds(stats.dac), part);
+  }
+  if (stats.adc) {
+    part = uah(UA_ADC, seconds(stats.adc));
+    total += part;
+    printf("  %-12s %12.6f s  %9.4f uAh\n", "battery adc", seconds(stats.adc), part);
+  }
+  if (stats.bod) {
+    part = uah(UA_BOD_SAMPLED, seconds(stats.bod));
+    total += part;
+    printf("  %-12s %12.3f s  %9.4f uAh\n", "bod", seconds(stats.bod), part);
+  }
+  if (stats.nvm_writes) {
+    double s = seconds(stats.nvm_writes * NVM_PAGE_WRITE);
+    part = uah(UA_NVM, s);
+    total += part;
+    printf("  %-12s %12.3f s  %9.4f uAh\n", "eeprom", s, part);
+  }
+  if (stats.osc20m) {
+    part = uah(UA_OSC20M, seconds(stats.osc20m));
+    total += part;
+    printf("  %-12s %12.3f s  %9.4f uAh\n", "osc20m", seconds(stats.osc20m), part);
+  }
+  part = uah(UA_LED, seconds(stats.led) + stats.led_pulsed);
+  total += part;
+  printf("  %-12s %12.3f s  %9.4f uAh\n", "led", seconds(stats.led) + stats.led_pulsed, part);
+  printf("  %-12s %12s    %9.4f uAh  (%.2f uA average)\n", "total", "", total,
+    sim_now ? total * 3600 / seconds(sim_now) : 0);
+  // the awake share of each lcd transaction: handlers, idle and the bus
+  if (stats.lcd_updates) {
+    double awake = stats.handler_uas + stats.sleep_uas[active] + stats.sleep_uas[idle]
+      + UA_TWI * seconds(stats.twi_busy);
+    printf("  %-12s %12u    %9.4f nAh  (%.2f MHz at the end)\n", "per update", stats.lcd_updates,
+      awake / 3.6 / stats.lcd_updates, clk_per() / 1e6);
+  }
+  return total;
+
+}
+
+
+// ---------- report ---------- //
+
+// cycles of one trace() with the atomic section, counted by hand
+#define TRACE_CYCLES 25
+
+// print the statistics and check the budgets, returns the failures
+static int report() {
+
+  double minutes = seconds(sim_now) / 60;
+
+  printf("\n--- simulated %.3f s ---\n", seconds(sim_now));
+  printf("wakeups:                       cycles (est.)  worst latency\n");
+  for (uint8_t v = 0; v < vectors; v++) {
+    printf("  %-12s %8u  (%6.1f/min)  %8llu  %9.1f us\n", vector_names[v], stats.wakeups[v],
+      minutes > 0 ? stats.wakeups[v] / minutes : 0,
+      (unsigned long long)stats.wakeups[v] * handler_cycles[v],
+      seconds(stats.latency[v]) * 1e6);
+  }
+  printf("twi bytes:     %8u (%u stalled, %u arbitrations lost)\n",
+    stats.twi_bytes, stats.twi_stalls, stats.twi_arblost);
+  printf("remote bytes:  %8u (%u stalled)\n", stats.remote_bytes, stats.remote_stalls);
+  printf("display bytes: %8u sent, %u skipped\n",
+    (unsigned)display_bytes_sent, (unsigned)display_bytes_skipped);
+  printf("i2c queue:     %8u high-water, %u dropped, %u failed, %u retried\n",
+    i2c_queue_highwater, i2c_dropped, i2c_failed, i2c_retried);
+  printf("startup:       first frame %.1f ms, crystal stable %.1f ms, rtc on it %.1f ms\n",
+    boot.frame == SIM_NEVER ? -1 : seconds(boot.frame) * 1000,
+    boot.crystal == SIM_NEVER ? -1 : seconds(boot.crystal) * 1000,
+    boot.rtc == SIM_NEVER ? -1 : seconds(boot.rtc) * 1000);
+  printf("wake to frame: %8.1f ms worst of %u\n", seconds(boot.wake_max) * 1000, boot.wakes);
+  uint64_t handlers = 0;
+  for (uint8_t v = 0; v < vectors; v++) handlers += (uint64_t)stats.wakeups[v] * handler_cycles[v];
+  uint32_t traced = trace_total();
+  printf("trace:         %8u entries, %u cycles (est.), %.1f %% of the handlers\n",
+    traced, traced * TRACE_CYCLES, handlers ? 100.0 * traced * TRACE_CYCLES / handlers : 0);
+  printf("eeprom pages:  %8u written (", stats.nvm_writes);
+  for (uint8_t page = 0; page < EEPROM_SIZE / EEPROM_PAGE_SIZE; page++) {
+    printf(page ? " %u" : "%u", stats.nvm_pages[page]);
+  }
+  printf(" per page)\n");
+  double charge = energy();
+
+  // regressions against the scenario's budgets
+  int failures = 0;
+  if (sim_budget_uah >= 0 && charge > sim_budget_uah) {
+    printf("OVER BUDGET: %.4f uAh > %.4f uAh\n", charge, sim_budget_uah);
+    failures++;
+  }
+  if (sim_budget_wakeups >= 0 && total_wakeups() > sim_budget_wakeups) {
+    printf("OVER BUDGET: %u wakeups > %lld\n", total_wakeups(), (long long)sim_budget_wakeups);
+    failures++;
+  }
+  for (uint8_t v = 0; v < vectors; v++) {
+    double us = seconds(stats.latency[v]) * 1e6;
+    if (sim_budget_latency_us >= 0 && us > sim_budget_latency_us) {
+      printf("OVER BUDGET: %s latency %.1f us > %.1f us\n", vector_names[v], us, sim_budget_latency_us);
+      failures++;
+    }
+  }
+  return failures;
+
+}
+
+void sim_finish() {
+
+  script_failures += report();
+  if (script_failures) {
+    printf("FAILED: %d expectation(s)\n", script_failures);
+    exit(1);
+  }
+  printf("OK\n");
+  exit(0);
+
+}
+
+/**
+ * A power cycle can't reset the firmware's static variables in this
+ * process, so the scenario continues in a new one, see script.c: the
+ * committed EEPROM and the failures so far are passed in the environment.
+ * Uncommitted page buffer contents are lost, like on the target. The
+ * budgets are checked for each part separately.
+ **/
+void sim_reset() {
+
+  script_failures += report();
+  sim_log("power cycle");
+
+  char path[] = "/tmp/teatime-eeprom-XXXXXX";
+  int fd = mkstemp(path);
+  FILE *f = fd < 0 ? NULL : fdopen(fd, "wb");
+  if (f == NULL || fwrite(eeprom_committed, 1, EEPROM_SIZE, f) != EEPROM_SIZE) {
+    perror("sim_reset");
+    exit(2);
+  }
+  fclose(f);
+  char failures[16];
+  snprintf(failures, sizeof(failures), "%d", script_failures);
+  setenv("SIM_EEPROM", path, 1);
+  setenv("SIM_FAILURES", failures, 1);
+  fflush(stdout);
+
+}
@@ -0,0 +1,73 @@
+// Host simulator for the teatime firmware
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "device.h"
+
+
+// simulated time in 1/1024 of a 32.768 kHz crystal cycle
+typedef uint64_t sim_time;
+#define SIM_CYCLE  1024ULL
+#define SIM_SECOND (32768ULL * SIM_CYCLE)
+#define SIM_MS(ms) ((sim_time)(ms) * SIM_SECOND / 1000)
+#define SIM_NEVER  UINT64_MAX
+
+extern sim_time sim_now;
+
+// buttons on PORTB
+#define SIM_BUTTON_ADD PIN6_bm
+#define SIM_BUTTON_SET PIN7_bm
+
+bool sim_button(uint8_t pin, bool pressed);
+bool sim_led();
+const char *sim_led_state();
+void sim_finish();
+void sim_reset();
+void sim_log(const char *format, ...);
+
+// supply voltage for the adc, see the battery command
+extern double sim_vdd;
+
+// budgets from the scenario, a negative value means unchecked
+extern double sim_budget_uah;
+extern int64_t sim_budget_wakeups;
+extern double sim_budget_latency_us; // worst of any interrupt
+
+// remote host on the external connector, see sim.c
+void sim_remote(uint8_t reg, const uint8_t *data, uint8_t writes, uint8_t reads);
+const char *sim_remote_result();
+
+// rohm bu9796 lcd driver model, see bu9796.c
+void bu9796_power(bool on);
+void bu9796_start();
+void bu9796_write(uint8_t byte);
+void bu9796_stop();
+const char *bu9796_text();
+uint8_t bu9796_blink();
+double bu9796_current();
+
+// one input on one steep of the state machine in teatime.c, checked
+// against the table in machine.c
+typedef struct {
+  bool taken;         // not refused by run_steep()
+  uint8_t next;       // state of the steep afterwards
+  uint16_t actions;   // of the table entry
+  uint32_t countdown; // of the steep afterwards
+  uint8_t shown;
+  const char *led;    // as in sim_led_state()
+  bool awake;         // the auto-off deadline was restarted
+} sim_transition;
+
+void sim_steep_input(uint8_t index, uint8_t state, uint8_t input, sim_transition *result);
+int machine_check();
+
+// scenario scripts, see script.c
+void script_load();
+sim_time script_due();
+bool script_step();
+extern int script_failures;
@@ -4,7 +4,7 @@
 
 #pragma once
 
-#include <avr/io.h>
+#include "hal.h"
 
 // enable sleep modes in general
 #define sleep_enable() SLPCTRL.CTRLA |= SLPCTRL_SEN_bm;
@@ -15,5 +15,16 @@
 // configure standy sleep mode (RTC remains active)
 #define sleep_configure_standby() SLPCTRL.CTRLA = SLPCTRL_SMODE_STDBY_gc | (SLPCTRL.CTRLA & SLPCTRL_SEN_bm)
 
-// configure power-down sleep mode (only PIT can wake)
+// configure power-down sleep mode (only the PIT and pin changes can wake)
 #define sleep_configure_powerdown() SLPCTRL.CTRLA = SLPCTRL_SMODE_PDOWN_gc | (SLPCTRL.CTRLA & SLPCTRL_SEN_bm)
+
+// sleep once in idle, e.g. while the twi needs the peripheral clock,
+// and return to the configured mode after the wakeup; call with the
+// interrupts disabled, they are enabled while sleeping
+#define sleep_cpu_idle() do { \
+    uint8_t configured_ = SLPCTRL.CTRLA; \
+    sleep_configure_idle(); \
+    sei(); \
+    sleep_cpu(); \
+    SLPCTRL.CTRLA = configured_; \
+  } while (0)
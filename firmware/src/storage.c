@@ -0,0 +1,166 @@
+// Wear-levelled log of the steeps in the EEPROM
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#include <string.h>
+
+#include "storage.h"
+#include "events.h"
+#include "profile.h"
+#include "flags.h"
+#include "trace.h"
+
+/**
+ * The EEPROM holds a log of records, one per page, which is written
+ * round-robin: each save goes to the page after the newest record with
+ * the next sequence number, so the pages wear evenly and the previous
+ * record stays intact until the next one is complete. A CRC over each
+ * record rejects pages that were erased or cut off by a power failure.
+ * At boot, the valid record with the highest sequence number wins.
+ *
+ * A page is loaded into the page buffer and committed with a single
+ * erase/write command. The NVM controller finishes it on its own in
+ * about 4 ms and keeps the clock running until then, even in standby.
+ * Changes are deferred by STORAGE_DELAY_SECS and a record identical to
+ * the newest one is not written at all, so adding time or starting a
+ * brew costs one page write and the ticks of a countdown cost none.
+ *
+ * To keep the remaining time of a running countdown, the voltage level
+ * monitor of the brown-out detector interrupts 25 % above its level,
+ * i.e. at 2.25 V with the 1.8 V level from the fuses, and the record is
+ * saved as the next event. In standby the detector only samples, and only
+ * while storage_guard() says there's something worth saving.
+ **/
+
+#define STORAGE_SLOTS (EEPROM_SIZE / EEPROM_PAGE_SIZE)
+
+// changing the layout of the record invalidates the old ones
+#define STORAGE_LAYOUT 0x5A
+
+typedef struct __attribute__((packed)) {
+  uint8_t sequence;
+  storage_record record;
+  uint8_t crc;
+} entry;
+
+_Static_assert(sizeof(entry) <= EEPROM_PAGE_SIZE, "a record must fit into one eeprom page");
+
+// newest valid slot, or STORAGE_SLOTS if there is none
+static uint8_t newest = STORAGE_SLOTS;
+static uint8_t sequence = 0;
+
+static volatile uint8_t *slot_address(uint8_t slot) {
+  return (volatile uint8_t *)(EEPROM_START + (uint16_t)slot * EEPROM_PAGE_SIZE);
+}
+
+// crc-8 with the polynomial x^8 + x^2 + x + 1
+static uint8_t crc8(const uint8_t *data, uint8_t length) {
+  uint8_t crc = STORAGE_LAYOUT;
+  while (length--) {
+    crc ^= *data++;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+    }
+  }
+  return crc;
+}
+
+// copy a slot out of the eeprom and check it
+static bool read_slot(uint8_t slot, entry *e) {
+  while (NVMCTRL.STATUS & NVMCTRL_EEBUSY_bm);
+  volatile uint8_t *src = slot_address(slot);
+  uint8_t *dst = (uint8_t *)e;
+  for (uint8_t i = 0; i < sizeof(entry); i++) dst[i] = src[i];
+  return crc8(dst, sizeof(entry) - 1) == e->crc;
+}
+
+
+// ---------- boot ---------- //
+
+// enable the early warning of the brown-out detector
+void setup_storage() {
+  BOD.VLMCTRLA = BOD_VLMLVL_25ABOVE_gc;
+  BOD.INTCTRL = BOD_VLMCFG_BELOW_gc | BOD_VLMIE_bm;
+}
+
+// find the newest valid record, returns false if there is none
+bool storage_restore(storage_record *record) {
+  entry e;
+  newest = STORAGE_SLOTS;
+  for (uint8_t slot = 0; slot < STORAGE_SLOTS; slot++) {
+    if (!read_slot(slot, &e)) continue;
+    // the sequence wraps, but the valid ones are never far apart
+    if (newest == STORAGE_SLOTS || (int8_t)(e.sequence - sequence) > 0) {
+      newest = slot;
+      sequence = e.sequence;
+      memcpy(record, &e.record, sizeof(storage_record));
+    }
+  }
+  return newest != STORAGE_SLOTS;
+}
+
+
+// ---------- saving ---------- //
+
+void storage_save() {
+  MAIN_FLAGS &= ~MAIN_DEFERRED;
+  timer_cancel(timer_storage);
+
+  entry e;
+  storage_collect(&e.record);
+  if (newest != STORAGE_SLOTS) {
+    entry last;
+    if (read_slot(newest, &last) && memcmp(&last.record, &e.record, sizeof(storage_record)) == 0) return;
+  }
+  e.sequence = sequence + 1;
+  e.crc = crc8((const uint8_t *)&e, sizeof(entry) - 1);
+
+  // load the page buffer and commit only the loaded bytes
+  uint8_t slot = (newest == STORAGE_SLOTS) ? 0 : (newest + 1) % STORAGE_SLOTS;
+  while (NVMCTRL.STATUS & NVMCTRL_EEBUSY_bm);
+  volatile uint8_t *dst = slot_address(slot);
+  const uint8_t *src = (const uint8_t *)&e;
+  for (uint8_t i = 0; i < sizeof(entry); i++) dst[i] = src[i];
+  _PROTECTED_WRITE_SPM(NVMCTRL.CTRLA, NVMCTRL_CMD_PAGEERASEWRITE_gc);
+
+  newest = slot;
+  sequence = e.sequence;
+}
+
+static void deferred_save(timer_id id __attribute__((unused))) {
+  storage_save();
+}
+
+// save a while after the last change, further changes restart the delay
+void storage_defer() {
+  MAIN_FLAGS |= MAIN_DEFERRED;
+  timer_set(timer_storage, rtc_time() + (uint16_t)STORAGE_DELAY_SECS * RTC_HZ, deferred_save);
+}
+
+// save a deferred change right now, e.g. before power-down
+void storage_flush() {
+  if (MAIN_FLAGS & MAIN_DEFERRED) storage_save();
+}
+
+
+// ---------- brown-out ---------- //
+
+// sample the supply in standby as long as a countdown could get lost
+void storage_guard(bool on) {
+  uint8_t ctrla = BOD.CTRLA & ~(BOD_SLEEP_gm | BOD_SAMPFREQ_bm);
+  if (on) ctrla |= BOD_SLEEP_SAMPLED_gc | BOD_SAMPFREQ_125HZ_gc;
+  if (ctrla != BOD.CTRLA) _PROTECTED_WRITE(BOD.CTRLA, ctrla);
+}
+
+// the supply is about to fail, save while the cpu still runs
+ISR(BOD_VLM_vect) {
+  profile_isr(profile_bod);
+  trace(trace_isr, profile_bod);
+  BOD.INTFLAGS = BOD_VLMIF_bm;
+  events_post(event_brownout);
+}
+
+// the main loop is next after the interrupt, so this is just as early
+void storage_event() {
+  storage_save();
+}
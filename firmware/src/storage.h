@@ -0,0 +1,41 @@
+// Wear-levelled log of the steeps in the EEPROM
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hal.h"
+#include "timers.h"
+#include "countdown.h"
+
+// a change is saved once nothing else changed for this long, override
+// with -D; at most 62 seconds, see TIMER_AHEAD
+#ifndef STORAGE_DELAY_SECS
+#define STORAGE_DELAY_SECS 10
+#endif
+
+// what is kept of each steep, packed to the same layout on the host
+typedef struct __attribute__((packed)) {
+  uint8_t state;
+  bcd_time preset;
+  bcd_time countdown;
+} storage_steep;
+
+typedef struct __attribute__((packed)) {
+  uint8_t shown;
+  storage_steep steeps[TIMER_STEEPS];
+} storage_record;
+
+void setup_storage();
+bool storage_restore(storage_record *record);
+void storage_defer();
+void storage_flush();
+void storage_save();
+void storage_guard(bool on);
+void storage_event();
+
+// called to fill in the record right before it is written
+extern void storage_collect(storage_record *record);
@@ -2,48 +2,64 @@
 // Copyright (c) 2022 Anton Semjonov
 // Licensed under the MIT License
 
-#include <avr/io.h>
-#include <avr/interrupt.h>
-#include <avr/delay.h>
-#include <avr/sleep.h>
-
+#include "hal.h"
+#include "clock.h"
 #include "oscillators.h"
+#include "timers.h"
 #include "sleepmode.h"
 #include "lcddriver.h"
-#include "segments.h"
-#include "lcddriver.h"
+#include "font.h"
+#include "display.h"
+#include "countdown.h"
 #include "i2c_controller.h"
 #include "ports.h"
+#include "buttons.h"
 #include "led.h"
+#include "battery.h"
+#include "storage.h"
+#include "events.h"
+#include "profile.h"
+#include "flags.h"
+#include "trace.h"
 
-// counters for button press duration
-volatile uint8_t btn_add_count = 0;
-volatile bool    btn_add_was_long = false;
-volatile uint8_t btn_set_count = 0;
-volatile bool    btn_set_was_long = false;
-
-// how many ticks for a long press
-const int long_len = 32;
+#ifdef SIMULATOR
+#include "sim/sim.h"
+#endif
 
-// "state machine"
+// state machine of each countdown, see the transitions below
 typedef enum {
   idle = 0,
   running,
   paused,
   finished,
+  empty, // idle at zero, only a row of the table and never stored
+  states,
 } teatime_state;
-volatile teatime_state state = idle;
 
-// mini buffer for lcd commands
-uint8_t lcd_commands[3] = { 0x00, 0x00, 0x00 };
+// several steeps can run at once, the display shows one of them
+typedef struct {
+  teatime_state state;
+  bcd_time countdown;
+  bcd_time preset;
+  uint16_t tick_at;   // the countdown steps by tick_secs at tick_at
+  uint8_t tick_secs;
+  uint16_t tick_rest; // until the next second while paused
+  bool minutes_only;
+} steep;
+
+steep steeps[TIMER_STEEPS];
+uint8_t shown = 0;
+
+// countdowns from this long show minutes only until the final minute,
+// set to BCD_MAX to always show the seconds
+const bcd_time minutes_above = 0x01000; // 10:00
 
-// set countdown value
-volatile uint16_t countdown_preset = 0;
-volatile uint16_t countdown = 0;
-volatile uint16_t rtc_value = 0;
+// switch everything off after a while with all steeps in idle
+const uint8_t auto_off_secs = 60;
+bool pit_halted = false;
 
 /**
- * State machine with button presses:
+ * State machine with button presses, each on the shown steep:
  * (×btn = short press, |btn = long press)
  * 
  * [0] "00:00" set time
@@ -51,163 +67,819 @@ volatile uint16_t rtc_value = 0;
  *    |add --> + 1 minute (+ hold)
  *    ×set --> [1] running, store countdown value as preset
  * 
- * [1] running, time runs down, switch to [2] end on zero
+ * [1] running, time runs down, switch to [2] end on zero;
+ *     long countdowns show "45'" or "1h45" and step once per minute
  *    ×add, |add --> as [0], but not added to preset
  *    ×set --> pause/unpause
  * 
- * [2] end, led and display is blinking
+ * [2] end, led and display is blinking; a steep that ends in the
+ *     background is shown right away, the others keep running
  *    ×set --> reset to [0] with previously preset time
  * 
+ * Holding add and pressing set shows the next steep. The second and
+ * third one are marked with a point after the last or second-to-last
+ * digit. Holding set for a second resets the shown steep to zero.
+ * 
+ * The device is asleep after a minute without a button press with all
+ * steeps in [0]; the lcd is powered off and the mcu is in power-down
+ *    any edge --> awake, all steeps with their previously preset time
+ * 
+ * The presets and the countdowns are saved to the EEPROM a few seconds
+ * after each change and when the supply fails. After a power cycle, a
+ * countdown that was running or paused continues paused in [1].
+ * 
+ * The same transitions are the table in the state machine section.
+ * 
 **/
 
-void button_add() {
-  if (!(pressed_add)) {
-    // long press handled in tick()
-    if (state != finished) {
-      if (!btn_add_was_long) countdown += 10;
-      if (countdown >= 6000) countdown = 5999;
+void display_steep();
+void keep_awake();
+void auto_off(timer_id id);
+void wake_up();
+void start_countdown(steep *s);
+void pause_countdown(steep *s);
+void resume_countdown(steep *s);
+void resync_countdown(steep *s);
+void reset_steep(steep *s, bcd_time time);
+void alarm_led(bool on);
+void end_notice();
+void remember();
+void brew(steep *s);
+
+bool any_steep(teatime_state state) {
+  for (uint8_t i = 0; i < TIMER_STEEPS; i++) {
+    if (steeps[i].state == state) return true;
+  }
+  return false;
+}
+
+// show another steep, its countdown may have to catch up to the second
+void show_steep(uint8_t index) {
+  shown = index;
+  resync_countdown(&steeps[shown]);
+}
+
+
+// ---------- state machine ---------- //
+
+/**
+ * Everything that changes the state of a steep goes through one table
+ * of (state, input) -> (actions, next state) and run_steep(). The table
+ * is const, so it stays in the memory-mapped flash, two bytes per entry.
+ * The actions run in the order of their bits, the next state is stored
+ * before act_brew and the ones after it. An entry without actions that
+ * keeps the state is refused, e.g. to stop the repeats of a held button.
+ * The shown steep is redrawn once all events are handled, so its lcd
+ * blink and power follow from the state alone, see draw_steep().
+ **/
+
+typedef enum {
+  input_set = 0, // short press of set
+  input_set_up,  // set released
+  input_add,     // short press of add, released
+  input_add_up,  // add released after it was held
+  input_hold,    // add held, repeated every half second
+  input_clear,   // set held for a second
+  input_zero,    // the countdown ran out
+  input_start,   // remote commands, see i2c_target_written()
+  input_pause,
+  input_restart,
+  inputs,
+} steep_input;
+
+typedef enum {
+  act_pause    = 0x001, // pause_countdown()
+  act_resume   = 0x002, // resume_countdown()
+  act_add_10s  = 0x004,
+  act_add_1min = 0x008,
+  act_preset   = 0x010, // back to the preset, stopped
+  act_zero     = 0x020, // back to zero, stopped
+  act_brew     = 0x040, // the time becomes the preset and runs down
+  act_torch    = 0x080, // toggle the led, set without a time
+  act_dark     = 0x100, // led off unless another steep rings
+  act_alarm    = 0x200, // led pulses while any steep is finished
+  act_show     = 0x400, // show this steep, even over another one
+  act_remember = 0x800, // keep_awake() and remember()
+} steep_action;
+
+typedef struct {
+  uint16_t actions : 12;
+  uint16_t next : 4;
+} transition;
+
+// inputs that do the same in every state
+#define COMMON(state) \
+  [input_add_up]  = { act_remember, state }, \
+  [input_clear]   = { act_zero | act_alarm | act_remember, idle }, \
+  [input_restart] = { act_preset | act_alarm | act_remember, idle }
+
+const transition machine[states][inputs] = {
+  [empty] = {
+    COMMON(idle),
+    [input_set]    = { act_torch | act_remember, idle },
+    [input_set_up] = { act_dark | act_remember, idle },
+    [input_add]    = { act_add_10s | act_remember, idle },
+    [input_hold]   = { act_add_1min | act_remember, idle },
+    [input_zero]   = { 0, idle },
+    [input_start]  = { act_remember, idle },
+    [input_pause]  = { act_remember, idle },
+  },
+  [idle] = {
+    COMMON(idle),
+    [input_set]    = { act_brew | act_remember, running },
+    [input_set_up] = { act_dark | act_remember, idle },
+    [input_add]    = { act_add_10s | act_remember, idle },
+    [input_hold]   = { act_add_1min | act_remember, idle },
+    [input_zero]   = { 0, idle },
+    [input_start]  = { act_brew | act_remember, running },
+    [input_pause]  = { act_remember, idle },
+  },
+  [running] = {
+    COMMON(running),
+    [input_set]    = { act_pause | act_remember, paused },
+    [input_set_up] = { act_remember, running },
+    [input_add]    = { act_add_10s | act_remember, running },
+    [input_hold]   = { act_add_1min | act_remember, running },
+    [input_zero]   = { act_alarm | act_show | act_remember, finished },
+    [input_start]  = { act_remember, running },
+    [input_pause]  = { act_pause | act_remember, paused },
+  },
+  [paused] = {
+    COMMON(paused),
+    [input_set]    = { act_resume | act_remember, running },
+    [input_set_up] = { act_remember, paused },
+    [input_add]    = { act_add_10s | act_remember, paused },
+    [input_hold]   = { act_add_1min | act_remember, paused },
+    [input_zero]   = { 0, paused },
+    [input_start]  = { act_resume | act_remember, running },
+    [input_pause]  = { act_remember, paused },
+  },
+  [finished] = {
+    COMMON(finished),
+    [input_set]    = { act_preset | act_alarm | act_remember, idle },
+    [input_set_up] = { act_remember, finished },
+    [input_add]    = { act_remember, finished },
+    [input_hold]   = { 0, finished },
+    [input_zero]   = { 0, finished },
+    [input_start]  = { act_remember, finished },
+    [input_pause]  = { act_remember, finished },
+  },
+};
+
+_Static_assert(states <= 16 && act_remember < 0x1000, "the transitions must fit their bitfields");
+
+// apply an input to a steep, returns false if it was refused
+bool run_steep(steep *s, steep_input input) {
+  teatime_state row = s->state;
+  if (row == idle && s->countdown == BCD_ZERO) row = empty;
+  transition t = machine[row][input];
+  uint16_t act = t.actions;
+  if (act == 0 && t.next == s->state) return false;
+  trace(trace_steep + (s - steeps), input << 4 | t.next);
+
+  if (act & act_pause) pause_countdown(s);
+  if (act & act_resume) resume_countdown(s);
+  if (act & act_add_10s) s->countdown = bcd_add_10s(s->countdown);
+  if (act & act_add_1min) s->countdown = bcd_add_1min(s->countdown);
+  if (act & act_preset) reset_steep(s, s->preset);
+  if (act & act_zero) reset_steep(s, BCD_ZERO);
+  s->state = t.next;
+  if (act & act_brew) brew(s);
+  if (act & act_torch) led_toggle();
+  if (act & act_dark && !any_steep(finished)) led_off();
+  if (act & act_alarm) alarm_led(any_steep(finished));
+  if (act & act_show) show_steep(s - steeps);
+  if (act & act_remember) {
+    keep_awake();
+    remember();
+  }
+  if (s == &steeps[shown]) display_steep();
+  return true;
+}
+
+#ifdef SIMULATOR
+/**
+ * For the table check of the simulator, see sim/machine.c: put one
+ * steep into a state with 01:00 and a preset of 03:00, the others in
+ * idle at zero, apply an input and report what happened. Everything is
+ * left in idle at zero and the led off. Only called while the main loop
+ * sleeps, so the timer queue is not in use.
+ **/
+void sim_steep_input(uint8_t index, uint8_t state, uint8_t input, sim_transition *result) {
+  for (uint8_t i = 0; i < TIMER_STEEPS; i++) reset_steep(&steeps[i], BCD_ZERO);
+  alarm_led(false);
+  shown = 0;
+  steep *s = &steeps[index];
+  teatime_state row = state;
+  if (row == finished || row == empty) {
+    s->state = row == finished ? finished : idle;
+  } else {
+    s->countdown = 0x00100;
+    if (row != idle) {
+      s->state = running;
+      start_countdown(s);
     }
-    btn_add_count = 0;
-    btn_add_was_long = false;
-  }
-}
-
-void button_set() {
-  if (pressed_set) {
-
-    switch (state) {
-      case idle:
-        if (countdown == 0) {
-          led_toggle();
-          break;
-        }
-        countdown_preset = countdown;
-        run_rtc(1);
-        state = running;
-        break;
-
-      case running:
-        rtc_value = halt_rtc();
-        lcd_commands[0] = LCD_BLKCTL_cmd | LCD_BLKCTL_1Hz;
-        i2c_write(LCD_ADDRESS, lcd_commands, 1);
-        state = paused;
-        break;
-
-      case paused:
-        run_rtc(rtc_value);
-        lcd_commands[0] = LCD_BLKCTL_cmd | LCD_BLKCTL_off;
-        i2c_write(LCD_ADDRESS, lcd_commands, 1);
-        state = running;
-        break;
-
-      case finished:
-        countdown = countdown_preset;
-        lcd_commands[0] = LCD_BLKCTL_cmd | LCD_BLKCTL_off;
-        i2c_write(LCD_ADDRESS, lcd_commands, 1);
-        led_off();
-        state = idle;
-        break;
-      
-      default:
-        break;
+    if (row == paused) {
+      s->state = paused;
+      pause_countdown(s);
     }
+  }
+  s->preset = 0x00300;
+  if (row == finished) alarm_led(true);
+  timer_cancel(timer_auto_off);
+
+  result->taken = run_steep(s, input);
+  result->next = s->state;
+  result->actions = machine[row][input].actions;
+  result->countdown = s->countdown;
+  result->shown = shown;
+  result->led = sim_led_state();
+  result->awake = timer_pending(timer_auto_off);
+
+  for (uint8_t i = 0; i < TIMER_STEEPS; i++) reset_steep(&steeps[i], BCD_ZERO);
+  alarm_led(false);
+  shown = 0;
+  keep_awake();
+  display_steep();
+}
+#endif
+
+// the debounced button events come from buttons.c
+void button_press(button_id button) {
+  end_notice();
+  if (button != btn_set) return;
+
+  // add and set together switch to the next steep
+  if (buttons_pressed(btn_add)) {
+    show_steep((shown + 1) % TIMER_STEEPS);
+    buttons_ignore();
+    display_steep();
+    return;
+  }
+  run_steep(&steeps[shown], input_set);
+}
+
+// long presses, repeated every half second while held
+bool button_hold(button_id button, uint8_t holds) {
+  // a long press is activity, even where the steep ignores it
+  keep_awake();
+
+  // add one minute per step
+  if (button == btn_add) return run_steep(&steeps[shown], input_hold);
+  // hold set for a second to reset the shown steep
+  if (holds < 2) return true;
+  run_steep(&steeps[shown], input_clear);
+  return false;
+}
+
+void button_release(button_id button, uint8_t holds) {
+  steep_input input = input_set_up;
+  if (button == btn_add) {
+    // long presses were already counted in button_hold()
+    input = holds == 0 ? input_add : input_add_up;
+  }
+  run_steep(&steeps[shown], input);
+}
+
+// any raw edge wakes the device, before the press is debounced
+void button_edge() {
+  if (MAIN_FLAGS & MAIN_ASLEEP) wake_up();
+}
+
+// greeting shown during initialization
+const char hello[] = "HELO";
+
+// hours and long countdowns only change once per minute
+bool coarse(const steep *s, bcd_time time) {
+  return bcd_digit(time, 4) || (s->minutes_only && time > BCD_MINUTE);
+}
+
+// display a countdown time in 12:34 format, or as "1h45" with hours
+// and as "45' " with minutes only, both rounded up to full minutes
+void display_time(const steep *s, bcd_time time) {
+  uint8_t frame[DISPLAY_DIGITS];
+  bool counting = (s->state == running) || (s->state == paused);
+  if (bcd_digit(time, 4) || (counting && coarse(s, time))) {
+    time = bcd_ceil_minutes(time);
+  }
+  if (bcd_digit(time, 4)) {
+    frame[0] = NUMBERS[bcd_digit(time, 2)];
+    frame[1] = NUMBERS[bcd_digit(time, 3)];
+    frame[2] = CHAR_h;
+    frame[3] = NUMBERS[bcd_digit(time, 4)];
+  } else if (counting && coarse(s, time)) {
+    // minutes in place of the usual ones, a prime instead of the seconds
+    frame[0] = CHAR_SPACE;
+    frame[1] = CHAR_PRIME;
+    frame[2] = NUMBERS[bcd_digit(time, 2)];
+    frame[3] = bcd_digit(time, 3) ? NUMBERS[bcd_digit(time, 3)] : CHAR_SPACE;
   } else {
-    if (state == idle) {
-      led_off();
+    // one digit per nibble, seconds first
+    frame[0] = NUMBERS[bcd_digit(time, 0)];
+    frame[1] = NUMBERS[bcd_digit(time, 1)];
+    frame[2] = NUMBERS[bcd_digit(time, 2)] | CHAR_COLON;
+    frame[3] = NUMBERS[bcd_digit(time, 3)];
+    // when running, blink the colon on odd seconds
+    if ((s->state == running) && (time & 0x01)) {
+      frame[2] &= ~CHAR_COLON;
     }
-    btn_set_count = 0;
-    btn_set_was_long = false;
   }
+  // mark the second and third steep
+  if (shown > 0) frame[shown - 1] |= CHAR_POINT;
+  // only changed digits are sent to the lcd driver
+  display_frame(frame);
+}
+
+// the shown steep changed, it is drawn once all events are handled
+void display_steep() {
+  MAIN_FLAGS |= MAIN_REDRAW;
+}
+
+// show the selected steep, blinking when paused or finished; the lcd
+// runs in its lowest power profile unless the alarm is shown with a
+// good battery
+void draw_steep() {
+  MAIN_FLAGS &= ~MAIN_REDRAW;
+  if (MAIN_FLAGS & (MAIN_NOTICING | MAIN_ASLEEP)) return;
+  steep *s = &steeps[shown];
+  uint8_t blink = LCD_BLKCTL_off;
+  if (s->state == paused) blink = LCD_BLKCTL_1Hz;
+  if (s->state == finished) blink = LCD_BLKCTL_2Hz;
+  bool alarm = s->state == finished && battery_state() == battery_ok;
+  display_power(alarm ? lcd_power_alarm : lcd_power_low);
+  display_blink(blink);
+  display_time(s, s->countdown);
 }
 
-uint8_t mybuf[5] = {
-  // turn on display from DDRAM
-  LCD_MODESET_cmd | LCD_MODESET_ON | LCD_MODESET_bias_03,
-  // HELO (reverse order)
-  CHAR_0, CHAR_L, CHAR_E, CHAR_H,
-  // 0xF5, 0x85, 0x97, 0x67,
-};
 
-// display the countdown time in 12:34 format
-void display_time(uint16_t time) {
-  // split into mins:secs
-  uint8_t secs = time % 60;
-  uint8_t mins = time / 60;
-  // format seconds
-  mybuf[1] = NUMBERS[ secs       % 10];
-  mybuf[2] = NUMBERS[(secs / 10) % 10];
-  mybuf[3] = NUMBERS[ mins       % 10] | Ap;
-  mybuf[4] = NUMBERS[(mins / 10) % 10];
-  // when running, blink the colon
-  if ((state == running) && (secs % 2) == 1) {
-    mybuf[3] &= ~Ap;
-  }
-  i2c_write(LCD_ADDRESS, mybuf, 5);
-}
-
-
-// display button interrupt counts
-void tick() {
-  if (pressed_add && state != finished) {
-    btn_add_count++;
-    if (btn_add_count >= long_len) {
-      btn_add_was_long = true;
-      countdown += 60;
-      if (countdown >= 6000) countdown = 5999;
-      btn_add_count = 0;
+// ---------- countdown ---------- //
+
+/**
+ * Each countdown is a deadline on the rtc, not a periodic interrupt.
+ * A deadline subtracts tick_secs at once: a single second near the end
+ * of the shown steep, but the seconds up to the next full minute while
+ * coarse(). Steeps in the background are not displayed and step by a
+ * minute all the time, down to their end. Neither a long brew nor more
+ * steeps add wakeups every second.
+ **/
+
+void tick(timer_id id);
+
+timer_id steep_timer(const steep *s) {
+  return timer_steep + (s - steeps);
+}
+
+// set the next deadline relative to the previous one, so nothing drifts
+void next_tick(steep *s, uint16_t from) {
+  bcd_time t = s->countdown;
+  uint8_t secs = 1;
+  if (s != &steeps[shown] || coarse(s, t)) {
+    if (t > BCD_MINUTE) {
+      secs = bcd_seconds(t);
+      if (secs == 0) secs = 60;
+    } else {
+      secs = bcd_seconds(t) + (bcd_digit(t, 2) ? 60 : 0);
     }
   }
-  if (pressed_set) {
-    if (btn_set_count < long_len*2) {
-      btn_set_count++;
-    } else if (!btn_set_was_long) {
-      btn_set_was_long = true;
-      halt_rtc();
-      countdown_preset = countdown = 0;
-      lcd_commands[0] = LCD_BLKCTL_cmd | LCD_BLKCTL_off;
-      i2c_write(LCD_ADDRESS, lcd_commands, 1);
-      led_off();
-      state = idle;
-      btn_set_count = 0;
-    }
+  s->tick_secs = secs;
+  s->tick_at = from + (uint16_t)secs * RTC_HZ;
+  timer_set(steep_timer(s), s->tick_at, tick);
+}
+
+void tick(timer_id id) {
+  uint8_t index = id - timer_steep;
+  steep *s = &steeps[index];
+  s->countdown = bcd_subtract(s->countdown, s->tick_secs);
+  if (s->countdown == BCD_ZERO) {
+    run_steep(s, input_zero);
+    return;
   }
-  display_time(countdown);
+  next_tick(s, s->tick_at);
+  if (index == shown) display_steep();
+}
+
+void start_countdown(steep *s) {
+  s->minutes_only = s->countdown >= minutes_above;
+  next_tick(s, rtc_time());
+}
+
+// start an idle steep, its current time becomes the preset
+void brew(steep *s) {
+  s->preset = s->countdown;
+  start_countdown(s);
+  // measure the battery once per brew
+  battery_sample();
+}
+
+// time until the next tick of a running countdown
+uint16_t tick_left(const steep *s) {
+  uint16_t now = rtc_time();
+  return timer_due(now, s->tick_at) ? 1 : timer_until(now, s->tick_at);
 }
 
-// count down
-void second() {
-  if (countdown > 0)
-    countdown--;
-  if (countdown == 0) {
-    halt_rtc();
-    state = finished;
-    lcd_commands[0] = LCD_BLKCTL_cmd | LCD_BLKCTL_2Hz;
-    i2c_write(LCD_ADDRESS, lcd_commands, 1);
+// the countdown with the seconds that passed since the last tick
+bcd_time remaining(const steep *s) {
+  uint8_t pending = (tick_left(s) + RTC_HZ - 1) / RTC_HZ;
+  return bcd_subtract(s->countdown, s->tick_secs - pending);
+}
+
+// count the seconds that passed since the last tick and keep the
+// fraction of the current one for resume_countdown()
+void pause_countdown(steep *s) {
+  uint16_t left = tick_left(s);
+  uint8_t pending = (left + RTC_HZ - 1) / RTC_HZ;
+  timer_cancel(steep_timer(s));
+  s->countdown = remaining(s);
+  s->tick_rest = left - (pending - 1) * RTC_HZ;
+}
+
+void resume_countdown(steep *s) {
+  s->tick_secs = 1;
+  s->tick_at = rtc_time() + s->tick_rest;
+  timer_set(steep_timer(s), s->tick_at, tick);
+}
+
+// catch up with a steep that counted in the background
+void resync_countdown(steep *s) {
+  if (s->state != running) return;
+  pause_countdown(s);
+  resume_countdown(s);
+}
+
+void reset_steep(steep *s, bcd_time time) {
+  timer_cancel(steep_timer(s));
+  s->state = idle;
+  s->countdown = time;
+}
+
+// ---------- battery ---------- //
+
+// the led pulses during an alarm without waking the cpu, see led.c;
+// with a low battery it only flashes briefly from the rtc deadlines
+// instead, because TCB0 keeps the 20 MHz oscillator on in standby
+#define LED_FLASH  RTC_MS(125)
+#define LED_PERIOD RTC_HZ
+
+uint16_t flash_at = 0;
+
+void flash_led(timer_id id __attribute__((unused))) {
+  led_toggle();
+  flash_at += (PORTA.OUT & PIN5_bm) ? LED_FLASH : LED_PERIOD - LED_FLASH;
+  timer_set(timer_led, flash_at, flash_led);
+}
+
+void alarm_led(bool on) {
+  timer_cancel(timer_led);
+  led_alarm_off();
+  if (on && battery_state() == battery_ok) {
+    led_alarm(LED_ALARM_US);
+  } else if (on) {
     led_on();
+    flash_at = rtc_time() + LED_FLASH;
+    timer_set(timer_led, flash_at, flash_led);
+  }
+}
+
+// "Lo bAt" in two frames of a second each
+const char low_battery[][DISPLAY_DIGITS] = { "Lo  ", "bAt " };
+#define NOTICE_FRAMES (sizeof(low_battery) / DISPLAY_DIGITS)
+uint8_t notice_frame = 0;
+
+void next_notice(timer_id id __attribute__((unused))) {
+  if (notice_frame >= NOTICE_FRAMES) {
+    end_notice();
+    return;
+  }
+  uint8_t frame[DISPLAY_DIGITS];
+  font_render(frame, low_battery[notice_frame++], 0);
+  display_frame(frame);
+  timer_set(timer_notice, rtc_time() + RTC_HZ, next_notice);
+}
+
+// back to the countdown after the message or with the next button press
+void end_notice() {
+  if (!(MAIN_FLAGS & MAIN_NOTICING)) return;
+  MAIN_FLAGS &= ~MAIN_NOTICING;
+  timer_cancel(timer_notice);
+  display_steep();
+}
+
+// state of charge and the unused stack as of the last measurement,
+// see publish(); the stack is at its deepest in a busy wakeup anyway
+uint8_t percent = 0;
+uint8_t stack_unused = 0;
+
+// a new measurement is in, adapt the lcd and the led to the battery
+void battery_measured() {
+  percent = battery_percent();
+  uint16_t unused = trace_stack_unused();
+  stack_unused = unused > 0xFF ? 0xFF : unused;
+  if (any_steep(finished)) alarm_led(true);
+  if (battery_state() == battery_critical && !(MAIN_FLAGS & MAIN_NOTICING)) {
+    MAIN_FLAGS |= MAIN_NOTICING;
+    notice_frame = 0;
+    next_notice(timer_notice);
+  } else {
+    display_steep();
+  }
+}
+
+// ---------- storage ---------- //
+
+// save the steeps once they stopped changing, and watch the supply
+// while a countdown would get lost with it
+void remember() {
+  storage_defer();
+  storage_guard(any_steep(running) || any_steep(paused));
+}
+
+void storage_collect(storage_record *record) {
+  record->shown = shown;
+  for (uint8_t i = 0; i < TIMER_STEEPS; i++) {
+    const steep *s = &steeps[i];
+    storage_steep *saved = &record->steeps[i];
+    saved->state = s->state;
+    saved->preset = s->preset;
+    saved->countdown = (s->state == running) ? remaining(s) : s->countdown;
+  }
+}
+
+// continue from the newest record at boot; the time without power is
+// unknown, so running countdowns are paused and finished ones reset
+void restore() {
+  storage_record record;
+  if (!storage_restore(&record)) return;
+  for (uint8_t i = 0; i < TIMER_STEEPS; i++) {
+    const storage_steep *saved = &record.steeps[i];
+    steep *s = &steeps[i];
+    if (saved->preset > BCD_MAX || saved->countdown > BCD_MAX) continue;
+    s->preset = saved->preset;
+    bool counting = (saved->state == running) || (saved->state == paused);
+    if (counting && saved->countdown != BCD_ZERO) {
+      s->state = paused;
+      s->countdown = saved->countdown;
+      s->minutes_only = s->preset >= minutes_above;
+      s->tick_rest = RTC_HZ;
+    } else {
+      s->state = idle;
+      s->countdown = s->preset;
+    }
+  }
+  if (record.shown < TIMER_STEEPS) shown = record.shown;
+  storage_guard(any_steep(paused));
+}
+
+
+// ---------- auto-off ---------- //
+
+// restart the auto-off deadline with every button event, as long as
+// no steep is running, paused or ringing
+void keep_awake() {
+  for (uint8_t i = 0; i < TIMER_STEEPS; i++) {
+    if (steeps[i].state != idle) {
+      timer_cancel(timer_auto_off);
+      return;
+    }
   }
+  timer_set(timer_auto_off, rtc_time() + (uint16_t)auto_off_secs * RTC_HZ, auto_off);
+}
+
+// switch the display off, the power is cut in the main loop once sent
+void auto_off(timer_id id __attribute__((unused))) {
+  MAIN_FLAGS |= MAIN_ASLEEP;
+  storage_flush();
+  display_command(LCD_MODESET_cmd | LCD_MODESET_OFF);
+  display_flush();
+}
+
+// ---------- remote ---------- //
+
+/**
+ * Registers for a host on the external connector, see the target role
+ * in i2c_controller.c. They describe the shown steep as of the last
+ * event the main loop handled, e.g. the last tick of its countdown, so
+ * the bytes of a transfer don't rebuild the map; 16 bit values are
+ * little-endian. Writing a command to
+ * reg_command acts like the buttons would. In power-down the bus pins
+ * are off with the lcd, so the unit only answers while it is awake.
+ * The trace ring follows the map as a read-only window from reg_trace,
+ * entry (reg_traced - 1) % TRACE_SLOTS is the newest one; see trace.h.
+ **/
+
+typedef enum {
+  reg_state = 0x00,     // state of the shown steep: idle, running, paused, finished
+  reg_shown = 0x01,     // index of the shown steep
+  reg_remaining = 0x02, // its remaining time in seconds, 16 bit
+  reg_preset = 0x04,    // its preset in seconds, 16 bit
+  reg_battery = 0x06,   // supply voltage in mV, 16 bit, zero until measured
+  reg_percent = 0x08,   // battery state of charge in percent
+  reg_wakeups = 0x0A,   // wakeups of the cpu since the last power cycle, 16 bit
+  reg_command = 0x0C,   // write a remote_command here, reads as zero
+  reg_stack = 0x0D,     // bytes the stack never reached, up to 255
+  reg_traced = 0x0E,    // entries traced since the last power cycle, 16 bit
+  reg_count = reg_traced + 2,
+  reg_trace = I2C_REGISTERS, // the trace ring, four bytes per entry
+} remote_register;
+
+typedef enum {
+  remote_start = 1, // start an idle steep or resume a paused one
+  remote_pause,     // pause a running steep
+  remote_reset,     // back to the preset in idle
+} remote_command;
+
+_Static_assert(input_pause - input_start == remote_pause - remote_start &&
+  input_restart - input_start == remote_reset - remote_start, "the commands map onto the inputs");
+
+_Static_assert(reg_count <= I2C_REGISTERS, "the registers must fit the target's map");
+
+uint16_t wakeups = 0;
+
+// copy the state of the shown steep into the register map
+void publish() {
+  const steep *s = &steeps[shown];
+  uint16_t left = bcd_to_seconds(s->state == running ? remaining(s) : s->countdown);
+  uint16_t preset = bcd_to_seconds(s->preset);
+  uint16_t mv = battery_mv();
+  uint16_t traced = trace_total();
+  const uint8_t map[reg_count] = {
+    [reg_state] = s->state,
+    [reg_shown] = shown,
+    [reg_remaining] = left, [reg_remaining + 1] = left >> 8,
+    [reg_preset] = preset, [reg_preset + 1] = preset >> 8,
+    [reg_battery] = mv, [reg_battery + 1] = mv >> 8,
+    [reg_percent] = percent,
+    [reg_wakeups] = wakeups, [reg_wakeups + 1] = wakeups >> 8,
+    [reg_stack] = stack_unused,
+    [reg_traced] = traced, [reg_traced + 1] = traced >> 8,
+  };
+  i2c_target_set(0, map, sizeof(map));
+}
+
+// a remote host wrote a register, only the command is writable
+void i2c_target_written(uint8_t reg, uint8_t value) {
+  if (reg != reg_command) return;
+  if (MAIN_FLAGS & MAIN_ASLEEP) wake_up();
+  end_notice();
+  if (value < remote_start || value > remote_reset) return;
+  run_steep(&steeps[shown], input_start + (value - remote_start));
+}
+
+
+// ---------- clock ---------- //
+
+// the clock point while the battery is good, override with -D
+#ifndef CLOCK_AWAKE
+#define CLOCK_AWAKE clock_5mhz
+#endif
+
+// the mcu is only specified for 10 MHz down to 2.7 V
+clock_point clock_policy() {
+  if (battery_state() != battery_ok) return clock_5mhz;
+  return CLOCK_AWAKE;
+}
+
+
+// ---------- startup ---------- //
+
+// the rtc runs from the internal oscillator until the crystal is stable
+#define CRYSTAL_POLL RTC_MS(125)
+
+void crystal_poll(timer_id id __attribute__((unused))) {
+  if (rtc_crystal()) {
+    profile_stage(boot_crystal);
+    return;
+  }
+  timer_set(timer_crystal, rtc_time() + CRYSTAL_POLL, crystal_poll);
+}
+
+/**
+ * Called from the main loop when the display off command went out.
+ * In power-down, only the button edges can wake the cpu. The RTC does
+ * not count there and with the PIT halted, nothing else requests the
+ * crystal, so it stops as well. A deadline that is still pending, e.g.
+ * the debouncing of a late edge, is delayed until the wakeup; such a
+ * pin stays muted until then and only the other one wakes the cpu.
+ * The first button edge powers the display right away and starts the
+ * crystal again; until it is stable, the RTC counts from the internal
+ * oscillator, so the debouncing doesn't wait for it.
+ **/
+void power_down() {
+  i2c_disable();
+  lcd_power_off();
+  timer_cancel(timer_crystal);
+  rtc_internal();
+  pit_halted = halt_pit();
+  display_invalidate();
+  sleep_configure_powerdown();
+  trace(trace_sleep, SLPCTRL.CTRLA);
+  MAIN_FLAGS |= MAIN_POWERED_DOWN;
+}
+
+// called by the first button edge while asleep; the lcd needs a software
+// reset and its configuration after power-on, which go out in the same
+// transaction as the preset
+void wake_up() {
+  if (MAIN_FLAGS & MAIN_POWERED_DOWN) {
+    MAIN_FLAGS &= ~MAIN_POWERED_DOWN;
+    sleep_configure_standby();
+    trace(trace_sleep, SLPCTRL.CTRLA);
+    setup_crystal();
+    if (pit_halted) run_pit();
+    lcd_power_on();
+    i2c_init();
+    display_reset(lcd_power_low);
+    crystal_poll(timer_crystal);
+  } else {
+    // the display off command went out, but the power is still on
+    display_command(LCD_MODESET_cmd | LCD_MODESET_ON | LCD_MODESET_bias_03);
+  }
+  MAIN_FLAGS &= ~MAIN_ASLEEP;
+  // the waking press itself is not counted
+  buttons_ignore();
+  for (uint8_t i = 0; i < TIMER_STEEPS; i++) {
+    steeps[i].countdown = steeps[i].preset;
+  }
+  keep_awake();
+  display_steep();
+  battery_sample();
 }
 
 int main() {
 
-  // setup all the things
+  // setup all the things; nothing waits for the crystal, which starts
+  // up in the background, see crystal_poll()
   setup_system_clock();
+  setup_profile();
+  profile_stage(boot_clock);
   setup_crystal();
-  setup_pit_ticks(RTC_PERIOD_CYC512_gc);
-  setup_rtc_seconds();
+  setup_rtc();
   setup_led();
   setup_lcddriver();
   setup_buttons();
+  setup_storage();
+  setup_interrupts();
   sleep_configure_standby();
   sleep_enable();
   disable_unused_pins();
   sei(); // enable interrupts
 
+  // note the cause of this reset, the flags stay set until cleared
+  uint8_t reset = RSTCTRL.RSTFR;
+  RSTCTRL.RSTFR = reset;
+  trace(trace_boot, reset);
+
+  // the steeps from before a power cycle, before anything is shown
+  restore();
+
   i2c_init();
-  i2c_write(LCD_ADDRESS, mybuf, 5);
+  #if TRACE_SLOTS
+  i2c_target_window(trace_ring, sizeof(trace_ring));
+  #endif
+  display_init();
+  // reset and configure the lcd in the same transaction as the greeting
+  display_reset(lcd_power_low);
+  uint8_t frame[DISPLAY_DIGITS];
+  font_render(frame, hello, 0);
+  display_frame(frame);
+  profile_stage(boot_frame);
 
   i2c_wait_until_idle();
-  mybuf[0] = 0x00;
+  profile_stage(boot_shown);
+
+  // no periodic refresh anymore, so show the initial time once
+  draw_steep();
+  keep_awake();
+  battery_sample();
+  crystal_poll(timer_crystal);
+  profile_stage(boot_ready);
 
-  for (;;) sleep_cpu();
+  for (;;) {
+    // handle what the interrupts posted, then draw the result once
+    bool handled = events_dispatch();
+    if (MAIN_FLAGS & MAIN_REDRAW) draw_steep();
+    // the map only changes with an event, not with a byte on the bus
+    if (handled && I2C_TARGET_ADDRESS) publish();
+    // finish a pending i2c stop condition before going back to sleep,
+    // unless another event came in meanwhile
+    cli();
+    if (events_pending() || i2c_poll()) {
+      sei();
+      continue;
+    }
+    // cut the lcd power once the display off command was sent
+    if ((MAIN_FLAGS & (MAIN_ASLEEP | MAIN_POWERED_DOWN)) == MAIN_ASLEEP && !i2c_busy()) {
+      power_down();
+    }
+    // switch the clock between transactions only
+    clock_update();
+    // the twi needs the peripheral clock, which stops in standby
+    if (i2c_busy()) {
+      sleep_cpu_idle();
+    } else {
+      sei();
+      sleep_cpu();
+    }
+    wakeups++;
+  }
 
 }
\ No newline at end of file
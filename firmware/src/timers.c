@@ -0,0 +1,126 @@
+// Deadlines on the RTC compare match
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#include "timers.h"
+
+/**
+ * All timing runs on the single RTC compare match. Each user owns a
+ * slot with one deadline in rtc_time() and a callback. The pending
+ * slots are kept in a queue sorted by their deadline, and the compare
+ * is always programmed to the head. Nothing wakes the cpu between
+ * deadlines, no matter how many slots are in use.
+ *
+ * rtc_time() wraps, so the queue is ordered by the time until each
+ * deadline. That order does not change as time passes: all distances
+ * shrink alike, and the nearest deadline is the first one to be due.
+ *
+ * The compare match only posts an event, so the queue and the callbacks
+ * are only ever touched from the main loop and need no locking.
+ **/
+
+typedef struct {
+  uint16_t at;
+  timer_callback expired;
+} timer;
+
+static timer slots[timers];
+static timer_id queue[timers]; // pending slots, nearest deadline first
+static uint8_t queued = 0;
+static bool dispatching = false;
+
+// deadlines closer than this are handled immediately, because the
+// compare register takes a few crystal cycles to synchronize
+#define TIMER_MARGIN 2
+
+
+// time from now until the deadline, passed ones appear far away
+uint16_t timer_until(uint16_t now, uint16_t at) {
+  return at - now;
+}
+
+bool timer_due(uint16_t now, uint16_t at) {
+  uint16_t d = timer_until(now, at);
+  return d < TIMER_MARGIN || d >= TIMER_AHEAD;
+}
+
+// sort key, due deadlines go first
+static uint16_t order(uint16_t now, uint16_t at) {
+  return timer_due(now, at) ? 0 : timer_until(now, at);
+}
+
+// ---------- queue ---------- //
+
+static void dequeue(timer_id id) {
+  uint8_t i = 0;
+  while (i < queued && queue[i] != id) i++;
+  if (i == queued) return;
+  queued--;
+  for (; i < queued; i++) queue[i] = queue[i + 1];
+}
+
+static void enqueue(timer_id id) {
+  uint16_t now = rtc_time();
+  uint16_t key = order(now, slots[id].at);
+  uint8_t i = queued++;
+  // shift later deadlines back, equal ones keep their order
+  while (i > 0 && order(now, slots[queue[i - 1]].at) > key) {
+    queue[i] = queue[i - 1];
+    i--;
+  }
+  queue[i] = id;
+}
+
+// run all due callbacks and program the compare for the next deadline
+static void dispatch() {
+
+  dispatching = true;
+  for (;;) {
+
+    // the callback may set a new deadline in its own slot
+    while (queued > 0 && timer_due(rtc_time(), slots[queue[0]].at)) {
+      timer_id id = queue[0];
+      dequeue(id);
+      slots[id].expired(id);
+    }
+
+    if (queued == 0) {
+      rtc_alarm_off();
+      break;
+    }
+    uint16_t next = slots[queue[0]].at;
+    rtc_alarm(next);
+    // it may have passed while arming the compare match
+    if (!timer_due(rtc_time(), next)) break;
+
+  }
+  dispatching = false;
+
+}
+
+// call expired() once rtc_time() reaches the given time
+void timer_set(timer_id id, uint16_t at, timer_callback expired) {
+  dequeue(id);
+  slots[id].at = at;
+  slots[id].expired = expired;
+  enqueue(id);
+  if (!dispatching) dispatch();
+}
+
+void timer_cancel(timer_id id) {
+  dequeue(id);
+  if (!dispatching) dispatch();
+}
+
+// the slot holds a deadline that has not expired yet
+bool timer_pending(timer_id id) {
+  for (uint8_t i = 0; i < queued; i++) {
+    if (queue[i] == id) return true;
+  }
+  return false;
+}
+
+// handle the rtc compare match, posted as event_deadline
+void deadline() {
+  dispatch();
+}
@@ -0,0 +1,40 @@
+// Deadlines on the RTC compare match
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "oscillators.h"
+
+// countdowns that can run at the same time
+#define TIMER_STEEPS 3
+
+// one slot per user, each holds at most one deadline
+typedef enum {
+  timer_buttons = 0, // debouncing and long presses
+  timer_auto_off,    // inactivity in idle
+  timer_led,         // flashing alarm with a low battery
+  timer_notice,      // next frame of a message
+  timer_storage,     // deferred save of the steeps
+  timer_crystal,     // polling the crystal while it starts up
+  timer_steep,       // next step of each countdown, TIMER_STEEPS slots
+  timers = timer_steep + TIMER_STEEPS,
+} timer_id;
+
+// called with the slot, which is free again at this point
+typedef void (*timer_callback)(timer_id id);
+
+// deadlines can be at most this far ahead, anything beyond has passed
+#define TIMER_AHEAD ((uint16_t)(62 * RTC_HZ))
+
+void timer_set(timer_id id, uint16_t at, timer_callback expired);
+void timer_cancel(timer_id id);
+bool timer_pending(timer_id id);
+
+uint16_t timer_until(uint16_t now, uint16_t at);
+bool timer_due(uint16_t now, uint16_t at);
+
+void deadline();
@@ -0,0 +1,76 @@
+// Ring buffer of recent events and the stack high-water mark
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#include "trace.h"
+
+#if TRACE_SLOTS
+
+trace_entry trace_ring[TRACE_SLOTS];
+volatile uint16_t trace_count = 0;
+
+// entries traced so far, the older ones were overwritten
+uint16_t trace_total() {
+  uint16_t count;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    count = trace_count;
+  }
+  return count;
+}
+
+#else
+
+uint16_t trace_total() {
+  return 0;
+}
+
+#endif
+
+
+// ---------- stack ---------- //
+
+#ifndef SIMULATOR
+
+#define STACK_PAINT 0xC5
+
+// end of the static variables and the initial stack pointer, from the linker
+extern uint8_t _end;
+extern uint8_t __stack;
+
+// paint the ram between the variables and the stack, right after the
+// stack pointer was set up and before anything was pushed; a naked
+// function has no prologue, so only asm is safe in here, see the
+// memory sections of avr-libc
+__attribute__((naked, used, section(".init3")))
+static void stack_paint() {
+  __asm__ volatile (
+    "    ldi r30, lo8(_end)       \n"
+    "    ldi r31, hi8(_end)       \n"
+    "    ldi r24, %0              \n"
+    "    ldi r25, hi8(__stack)    \n"
+    "    rjmp 2f                  \n"
+    "1:  st Z+, r24               \n"
+    "2:  cpi r30, lo8(__stack)    \n"
+    "    cpc r31, r25             \n"
+    "    brlo 1b                  \n"
+    "    breq 1b                  \n"
+    :
+    : "i" (STACK_PAINT)
+  );
+}
+
+// bytes between the variables and the deepest stack so far
+uint16_t trace_stack_unused() {
+  const uint8_t *p = &_end;
+  while (p <= &__stack && *p == STACK_PAINT) p++;
+  return p - &_end;
+}
+
+#else
+
+// the simulator runs on the host's stack
+uint16_t trace_stack_unused() {
+  return 0;
+}
+
+#endif
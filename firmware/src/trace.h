@@ -0,0 +1,67 @@
+// Ring buffer of recent events and the stack high-water mark
+// Copyright (c) 2022 Anton Semjonov
+// Licensed under the MIT License
+
+#pragma once
+
+#include <stdint.h>
+
+#include "hal.h"
+
+/**
+ * The last TRACE_SLOTS events are kept in RAM with the rtc counter of
+ * their time, so a unit that misbehaved in the field can tell what led
+ * up to it. Read trace_ring and trace_count by dumping the RAM through
+ * UPDI, or one entry at a time through the register map, see teatime.c.
+ * An entry is four stores in a short atomic section, about 25 cycles,
+ * so the trace stays on in regular builds; -D TRACE_SLOTS=0 removes it.
+ *
+ * The stack is painted before main() runs. The bytes the stack never
+ * reached still hold the paint, see trace_stack_unused().
+ **/
+
+// entries in the ring, a power of two; four bytes of RAM each
+#ifndef TRACE_SLOTS
+#define TRACE_SLOTS 8
+#endif
+
+typedef enum {
+  trace_boot = 0, // arg: reset flags, see RSTCTRL.RSTFR
+  trace_isr,      // arg: the profile_source of the handler
+  trace_i2c,      // arg: the i2c_error of a completed transaction
+  trace_sleep,    // arg: the new SLPCTRL.CTRLA
+  trace_steep,    // plus the index of the steep; arg: input << 4 | next state
+} trace_what;
+
+typedef struct {
+  uint16_t time; // rtc_time() of the event
+  uint8_t what;
+  uint8_t arg;
+} trace_entry;
+
+#if TRACE_SLOTS
+
+_Static_assert((TRACE_SLOTS & (TRACE_SLOTS - 1)) == 0, "the trace must wrap around");
+
+extern trace_entry trace_ring[TRACE_SLOTS];
+extern volatile uint16_t trace_count; // entries so far, the newest is at count - 1
+
+// note an event; inlined, so a handler stays without calls
+static inline void trace(uint8_t what, uint8_t arg) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    trace_entry *e = &trace_ring[trace_count & (TRACE_SLOTS - 1)];
+    e->time = RTC.CNT;
+    e->what = what;
+    e->arg = arg;
+    trace_count++;
+  }
+}
+
+#else
+
+#define trace(what, arg)
+
+#endif
+
+uint16_t trace_total();
+uint16_t trace_stack_unused();